@@ -0,0 +1,433 @@
+/*****************************************************************************
+*
+*
+* Module Name	: eeprom_cfg_store.c
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Journaled key / value configuration store on the external
+*				  EEPROM. Every change is appended as a new record (one page,
+*				  protected by CRC-16 and a sequence number) at the head of a
+*				  circular log, so cells wear evenly and a power loss during a
+*				  save leaves the previous value readable.
+*
+*				  At boot the log is scanned once and the newest record of each
+*				  key is kept in a RAM index with its value, so reads never
+*				  touch the bus. When the head reaches the slot of a live
+*				  record, that record is copied forward before the slot is
+*				  reused. A delete record is dropped there instead once no
+*				  older record of its key is left in the log.
+*
+* Controller	: 	ATSAM4E16CA-AUR
+*					1024 KB		Flash
+*					128 KB		RAM
+*
+/*****************************************************************************/
+
+/* System Includes */
+#include "asf.h"
+#include "user_uart.h"
+#include "string.h"
+
+/* User Includes */
+#include "eeprom_cfg_store.h"
+#include "definitions.h"
+
+/* Local definitions */
+#define CFG_NO_SLOT           (0xFFFF)
+#define CFG_NO_KEY            (0xFF)
+#define CFG_SCAN_SLOTS        (8)                                               // Slots read per bus transfer at boot.
+
+typedef struct
+{
+     uint16_t slot;                                                             // Slot of the newest record, CFG_NO_SLOT if none.
+     uint8_t len;                                                               // Value length or CFG_LEN_DELETED.
+     uint16_t copies;                                                           // Slots holding a valid record of the key, newest included.
+     uint32_t seq;
+     uint8_t value[CFG_MAX_VALUE];
+} CFG_INDEX;
+
+/* Local variables */
+static CFG_INDEX cfg_index[CFG_MAX_KEYS];
+static uint8_t cfg_live[(CFG_STORE_SLOTS + 7) / 8];                            // Bit set for slots holding a newest record.
+static uint8_t cfg_slot_key[CFG_STORE_SLOTS];                                   // Key of the valid record in each slot, CFG_NO_KEY if none.
+static uint16_t cfg_head = 0;
+static uint32_t cfg_seq = 0;                                                    // Highest sequence number in the log.
+static CFG_STORE_STATS cfg_stats;
+
+static uint16_t cfg_crc16(const uint8_t *rec);
+static uint8_t cfg_is_live(uint16_t slot);
+static void cfg_set_live(uint16_t slot, uint8_t live);
+static uint8_t cfg_write_record(uint8_t key, const uint8_t *data, uint8_t len);
+static uint8_t cfg_append(uint16_t slot, uint8_t key, uint8_t len, const uint8_t *data);
+
+/*****************************************************************************
+* Function name	: uint8_t cfg_store_init(void)
+* Returns		: uint8_t ---> EEPROM_OK, else the bus error of the scan.
+* Arguments		: None
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Scans every slot, checks the CRC and keeps the newest record
+*				  of each key in the RAM index. The head is placed after the
+*				  record with the highest sequence number.
+*              :
+* Notes		: Call once at boot after configure_twi.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t cfg_store_init(void)
+{
+     uint8_t buf[CFG_SCAN_SLOTS * PAGE_SIZE];
+     uint16_t newest_slot = CFG_NO_SLOT;
+
+     memset(cfg_index, 0, sizeof(cfg_index));
+     memset(cfg_live, 0, sizeof(cfg_live));
+     memset(cfg_slot_key, CFG_NO_KEY, sizeof(cfg_slot_key));
+     memset(&cfg_stats, 0, sizeof(cfg_stats));
+     for (uint8_t key = 0; key < CFG_MAX_KEYS; key++)
+     {
+          cfg_index[key].slot = CFG_NO_SLOT;
+     }
+     cfg_seq = 0;
+
+     for (uint16_t slot = 0; slot < CFG_STORE_SLOTS; slot += CFG_SCAN_SLOTS)
+     {
+          uint16_t count = ((CFG_STORE_SLOTS - slot) > CFG_SCAN_SLOTS) ? CFG_SCAN_SLOTS : (CFG_STORE_SLOTS - slot);
+
+          if (eeprom_read_frame(CFG_STORE_BASE + (slot * PAGE_SIZE), buf, count * PAGE_SIZE) != EEPROM_OK)
+          {
+               return EEPROM_ERR_BUS;
+          }
+
+          for (uint16_t idx = 0; idx < count; idx++)
+          {
+               uint8_t *rec = &buf[idx * PAGE_SIZE];
+               uint8_t key = rec[0];
+               uint8_t len = rec[1];
+               uint32_t seq = rec[2] | ((uint32_t)rec[3] << 8) | ((uint32_t)rec[4] << 16) | ((uint32_t)rec[5] << 24);
+               uint16_t crc = rec[6] | ((uint16_t)rec[7] << 8);
+
+               if ((key >= CFG_MAX_KEYS) || ((len > CFG_MAX_VALUE) && (len != CFG_LEN_DELETED)) || (crc != cfg_crc16(rec)))
+               {
+                    continue;                                                   // Erased, torn or foreign page.
+               }
+
+               cfg_stats.valid_at_boot++;
+               cfg_slot_key[slot + idx] = key;
+               cfg_index[key].copies++;
+               if ((newest_slot == CFG_NO_SLOT) || ((int32_t)(seq - cfg_seq) > 0))
+               {
+                    cfg_seq = seq;
+                    newest_slot = slot + idx;
+               }
+               if ((cfg_index[key].slot == CFG_NO_SLOT) || ((int32_t)(seq - cfg_index[key].seq) > 0))
+               {
+                    if (cfg_index[key].slot != CFG_NO_SLOT)
+                    {
+                         cfg_set_live(cfg_index[key].slot, 0);
+                    }
+                    cfg_index[key].slot = slot + idx;
+                    cfg_index[key].len = len;
+                    cfg_index[key].seq = seq;
+                    memcpy(cfg_index[key].value, &rec[CFG_REC_HDR_SIZE], CFG_MAX_VALUE);
+                    cfg_set_live(slot + idx, 1);
+               }
+          }
+     }
+
+     cfg_head = (newest_slot == CFG_NO_SLOT) ? 0 : ((newest_slot + 1) % CFG_STORE_SLOTS);
+
+     #if DEBUG_ALL || DEBUG_EXT_EEPROM
+     Print_Message("\nConfig store records : ");
+     Print_Number(cfg_stats.valid_at_boot);
+     Print_Message(" head : ");
+     Print_Number(cfg_head);
+     #endif
+
+     return EEPROM_OK;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t cfg_store_get(uint8_t key, uint8_t *data, uint8_t max_len, uint8_t *len)
+* Returns		: uint8_t ---> EEPROM_OK, EEPROM_ERR_NOT_FOUND or EEPROM_ERR_RANGE.
+* Arguments		: uint8_t key ---> Key to read.
+*				  uint8_t *data ---> Buffer for the value.
+*				  uint8_t max_len ---> Size of the buffer.
+*				  uint8_t *len ---> Returns the value length.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Copies the value from the RAM index, no bus access.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t cfg_store_get(uint8_t key, uint8_t *data, uint8_t max_len, uint8_t *len)
+{
+     *len = 0;
+     if (key >= CFG_MAX_KEYS)
+     {
+          return EEPROM_ERR_RANGE;
+     }
+     if ((cfg_index[key].slot == CFG_NO_SLOT) || (cfg_index[key].len == CFG_LEN_DELETED))
+     {
+          return EEPROM_ERR_NOT_FOUND;
+     }
+     if (cfg_index[key].len > max_len)
+     {
+          return EEPROM_ERR_RANGE;
+     }
+
+     memcpy(data, cfg_index[key].value, cfg_index[key].len);
+     *len = cfg_index[key].len;
+     return EEPROM_OK;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t cfg_store_set(uint8_t key, const uint8_t *data, uint8_t len)
+* Returns		: uint8_t ---> EEPROM_OK, EEPROM_ERR_RANGE, else the write error.
+* Arguments		: uint8_t key ---> Key to write.
+*				  const uint8_t *data ---> Value.
+*				  uint8_t len ---> Value length, 0 to CFG_MAX_VALUE.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Appends a record for the key at the head of the log. Nothing
+*				  is written when the stored value is already the same.
+*              :
+* Notes		: Costs one write cycle, two when a live record is relocated.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t cfg_store_set(uint8_t key, const uint8_t *data, uint8_t len)
+{
+     if ((key >= CFG_MAX_KEYS) || (len > CFG_MAX_VALUE))
+     {
+          return EEPROM_ERR_RANGE;
+     }
+     if ((cfg_index[key].slot != CFG_NO_SLOT) && (cfg_index[key].len == len) &&
+         (memcmp(cfg_index[key].value, data, len) == 0))
+     {
+          cfg_stats.writes_skipped++;
+          return EEPROM_OK;
+     }
+
+     return cfg_write_record(key, data, len);
+}
+
+/*****************************************************************************
+* Function name	: uint8_t cfg_store_delete(uint8_t key)
+* Returns		: uint8_t ---> EEPROM_OK, EEPROM_ERR_RANGE, else the write error.
+* Arguments		: uint8_t key ---> Key to remove.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Appends a delete record so older records of the key stay
+*				  hidden after a reboot.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t cfg_store_delete(uint8_t key)
+{
+     if (key >= CFG_MAX_KEYS)
+     {
+          return EEPROM_ERR_RANGE;
+     }
+     if ((cfg_index[key].slot == CFG_NO_SLOT) || (cfg_index[key].len == CFG_LEN_DELETED))
+     {
+          return EEPROM_OK;
+     }
+     return cfg_write_record(key, NULL, CFG_LEN_DELETED);
+}
+
+/*****************************************************************************
+* Function name	: void cfg_store_get_stats(CFG_STORE_STATS *stats)
+* Returns		: None
+* Arguments		: CFG_STORE_STATS *stats ---> Filled with a copy of the counters.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: NA
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+void cfg_store_get_stats(CFG_STORE_STATS *stats)
+{
+     *stats = cfg_stats;
+     stats->head = cfg_head;
+}
+
+/*****************************************************************************
+* Function name	: static uint8_t cfg_write_record(uint8_t key, const uint8_t *data, uint8_t len)
+* Returns		: uint8_t ---> EEPROM_OK, else the write error.
+* Arguments		: uint8_t key, const uint8_t *data, uint8_t len ---> Record.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: If the head slot holds a live record it is copied to the next
+*				  free slot first, then the record is written at the head. A
+*				  live delete record that is the last record of its key is not
+*				  copied, overwriting it leaves the key without records.
+*              :
+* Notes		: A reset between the two writes leaves both copies of the moved
+*			  record valid, the newer one wins at boot.
+* Global Variables Affected : NA
+*****************************************************************************/
+static uint8_t cfg_write_record(uint8_t key, const uint8_t *data, uint8_t len)
+{
+     uint8_t sts;
+
+     /* Move a live record out of the way of the head */
+     if (cfg_is_live(cfg_head))
+     {
+          uint16_t dest = (cfg_head + 1) % CFG_STORE_SLOTS;
+
+          while (cfg_is_live(dest))
+          {
+               dest = (dest + 1) % CFG_STORE_SLOTS;
+          }
+          for (uint8_t owner = 0; owner < CFG_MAX_KEYS; owner++)
+          {
+               if (cfg_index[owner].slot == cfg_head)
+               {
+                    if ((cfg_index[owner].len == CFG_LEN_DELETED) && (cfg_index[owner].copies == 1))
+                    {
+                         cfg_set_live(cfg_head, 0);
+                         cfg_index[owner].slot = CFG_NO_SLOT;
+                         cfg_stats.tombstones_dropped++;
+                         break;
+                    }
+                    sts = cfg_append(dest, owner, cfg_index[owner].len, cfg_index[owner].value);
+                    if (sts != EEPROM_OK)
+                    {
+                         return sts;
+                    }
+                    cfg_stats.relocations++;
+                    break;
+               }
+          }
+     }
+
+     sts = cfg_append(cfg_head, key, len, data);
+     if (sts == EEPROM_OK)
+     {
+          cfg_stats.records_written++;
+          cfg_head = (cfg_head + 1) % CFG_STORE_SLOTS;
+     }
+     return sts;
+}
+
+/*****************************************************************************
+* Function name	: static uint8_t cfg_append(uint16_t slot, uint8_t key, uint8_t len, const uint8_t *data)
+* Returns		: uint8_t ---> EEPROM_OK, else the write error.
+* Arguments		: uint16_t slot ---> Slot to write, must not be live.
+*				  uint8_t key, uint8_t len, const uint8_t *data ---> Record.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Builds the record with the next sequence number, writes it as
+*				  one page and points the index of the key at it.
+*              :
+* Notes		: The record count of the key the slot held before is reduced.
+*			  After a failed write it is kept, the old record may survive.
+* Global Variables Affected : NA
+*****************************************************************************/
+static uint8_t cfg_append(uint16_t slot, uint8_t key, uint8_t len, const uint8_t *data)
+{
+     uint8_t rec[PAGE_SIZE];
+     uint32_t seq = cfg_seq + 1;
+     uint16_t crc;
+     uint8_t sts;
+
+     memset(rec, 0xFF, PAGE_SIZE);
+     rec[0] = key;
+     rec[1] = len;
+     rec[2] = seq & 0xFF;
+     rec[3] = (seq >> 8) & 0xFF;
+     rec[4] = (seq >> 16) & 0xFF;
+     rec[5] = (seq >> 24) & 0xFF;
+     if (len != CFG_LEN_DELETED)
+     {
+          memcpy(&rec[CFG_REC_HDR_SIZE], data, len);
+     }
+     crc = cfg_crc16(rec);
+     rec[6] = crc & 0xFF;
+     rec[7] = crc >> 8;
+
+     sts = eeprom_write_frame(CFG_STORE_BASE + (slot * PAGE_SIZE), rec, PAGE_SIZE);
+     if (sts != EEPROM_OK)
+     {
+          return sts;
+     }
+
+     cfg_seq = seq;
+     if (cfg_slot_key[slot] != CFG_NO_KEY)
+     {
+          cfg_index[cfg_slot_key[slot]].copies--;
+     }
+     cfg_slot_key[slot] = key;
+     cfg_index[key].copies++;
+     if (cfg_index[key].slot != CFG_NO_SLOT)
+     {
+          cfg_set_live(cfg_index[key].slot, 0);
+     }
+     cfg_index[key].slot = slot;
+     cfg_index[key].len = len;
+     cfg_index[key].seq = seq;
+     memcpy(cfg_index[key].value, &rec[CFG_REC_HDR_SIZE], CFG_MAX_VALUE);
+     cfg_set_live(slot, 1);
+
+     return EEPROM_OK;
+}
+
+/*****************************************************************************
+* Function name	: static uint16_t cfg_crc16(const uint8_t *rec)
+* Returns		: uint16_t ---> CRC-16/CCITT (0x1021, init 0xFFFF).
+* Arguments		: const uint8_t *rec ---> One page record.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: CRC of the whole record except its CRC field.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+static uint16_t cfg_crc16(const uint8_t *rec)
+{
+     uint16_t crc = 0xFFFF;
+
+     for (uint8_t idx = 0; idx < PAGE_SIZE; idx++)
+     {
+          if ((idx == 6) || (idx == 7))
+          {
+               continue;
+          }
+          crc ^= (uint16_t)rec[idx] << 8;
+          for (uint8_t bit = 0; bit < 8; bit++)
+          {
+               crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+          }
+     }
+     return crc;
+}
+
+/*****************************************************************************
+* Function name	: static uint8_t cfg_is_live(uint16_t slot)
+* Returns		: uint8_t ---> 1 if the slot holds the newest record of a key.
+* Arguments		: uint16_t slot
+* Created by	: Anup Silvan Mascarenhas
+* Description	: NA
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+static uint8_t cfg_is_live(uint16_t slot)
+{
+     return (cfg_live[slot / 8] >> (slot % 8)) & 1;
+}
+
+/*****************************************************************************
+* Function name	: static void cfg_set_live(uint16_t slot, uint8_t live)
+* Returns		: None
+* Arguments		: uint16_t slot, uint8_t live
+* Created by	: Anup Silvan Mascarenhas
+* Description	: NA
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+static void cfg_set_live(uint16_t slot, uint8_t live)
+{
+     if (live)
+     {
+          cfg_live[slot / 8] |= (1 << (slot % 8));
+     }
+     else
+     {
+          cfg_live[slot / 8] &= ~(1 << (slot % 8));
+     }
+}
@@ -0,0 +1,64 @@
+/*****************************************************************************
+*                      
+*
+* Module Name	: eeprom_cfg_store.h
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Header file for eeprom_cfg_store.c
+*				  Defines the record layout and size of the journaled
+*				  configuration store.
+*
+*
+****************************************************************************/
+
+#ifndef EEPROM_CFG_STORE_H_
+#define EEPROM_CFG_STORE_H_
+
+#include "ext_eeprom.h"
+
+#ifndef CFG_STORE_SLOTS
+#define CFG_STORE_SLOTS       (64)                                              // One record per page, 2 KB.
+#endif
+
+#ifndef CFG_STORE_BASE
+#define CFG_STORE_BASE        (DATA_SIZE - (CFG_STORE_SLOTS * PAGE_SIZE))       // First address of the log, top of the device.
+#endif
+
+#ifndef CFG_MAX_KEYS
+#define CFG_MAX_KEYS          (32)                                              // Keys 0 to CFG_MAX_KEYS - 1.
+#endif
+
+#define CFG_REC_HDR_SIZE      (8)                                               // key, len, seq[4], crc[2]
+#define CFG_MAX_VALUE         (PAGE_SIZE - CFG_REC_HDR_SIZE)                    // 24 value bytes per record.
+#define CFG_LEN_DELETED       (0xFE)                                            // len of a delete record.
+
+#if (CFG_MAX_KEYS > (CFG_STORE_SLOTS - 2))
+#error "Config store needs at least two slots more than keys"
+#endif
+
+#if (CFG_STORE_BASE % PAGE_SIZE)
+#error "Config store must start on a page boundary"
+#endif
+
+#if (CFG_STORE_BASE < EEPROM_USER_SIZE) || ((CFG_STORE_BASE + (CFG_STORE_SLOTS * PAGE_SIZE)) > DATA_SIZE)
+#error "Config store overlaps the user area (EEPROM_USER_SIZE) or runs past the device"
+#endif
+
+typedef struct
+{
+     uint32_t records_written;                                                  // Records appended for cfg_store_set / cfg_store_delete.
+     uint32_t writes_skipped;                                                   // Sets that matched the stored value.
+     uint32_t relocations;                                                      // Live records copied forward by the head.
+     uint32_t tombstones_dropped;                                               // Delete records overwritten with no older record left.
+     uint16_t valid_at_boot;                                                    // Records with good CRC found by cfg_store_init.
+     uint16_t head;                                                             // Next slot to be written.
+} CFG_STORE_STATS;
+
+// Function prototypes
+uint8_t cfg_store_init(void);
+uint8_t cfg_store_get(uint8_t key, uint8_t *data, uint8_t max_len, uint8_t *len);
+uint8_t cfg_store_set(uint8_t key, const uint8_t *data, uint8_t len);
+uint8_t cfg_store_delete(uint8_t key);
+void cfg_store_get_stats(CFG_STORE_STATS *stats);
+
+#endif /* EEPROM_CFG_STORE_H_ */
@@ -0,0 +1,327 @@
+/*****************************************************************************
+*
+*
+* Module Name	: eeprom_shadow.c
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: RAM mirror of the user area of the external EEPROM
+*				  (EEPROM_USER_SIZE bytes from 0x0000). The mirror is
+*				  loaded with one read at boot, all reads are served from it
+*				  and writes only update it and mark the 32 byte pages they
+*				  change as dirty. eeprom_shadow_flush_task commits the dirty
+*				  pages from the main loop, one page write at a time and
+*				  without waiting for the write cycles.
+*
+* Controller	: 	ATSAM4E16CA-AUR
+*					1024 KB		Flash
+*					128 KB		RAM
+*
+/*****************************************************************************/
+
+/* System Includes */
+#include "asf.h"
+#include "user_uart.h"
+#include "string.h"
+#include "user_i2c.h"
+
+/* User Includes */
+#include "eeprom_shadow.h"
+#include "definitions.h"
+
+/* Local variables */
+static uint8_t shadow_mem[EEPROM_USER_SIZE];                                    // Mirror of the user area.
+static uint32_t shadow_dirty[SHADOW_PAGES / 32];                                // One bit per page.
+static uint16_t shadow_scan = 0;                                                // Page the next dirty search starts at.
+static uint16_t shadow_wr_page = 0;                                             // Page of the write cycle in flight.
+static uint8_t shadow_wr_busy = 0;
+static uint32_t shadow_polls = 0;
+static EEPROM_SHADOW_STATS shadow_stats;
+
+static void shadow_mark_dirty(uint16_t page);
+static uint16_t shadow_next_dirty(void);
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_shadow_init(void)
+* Returns		: uint8_t ---> EEPROM_OK or EEPROM_ERR_BUS.
+* Arguments		: None
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Loads the mirror with a single eeprom_read_frame of EEPROM_USER_SIZE
+*				  bytes and clears the dirty bitmap.
+*              :
+* Notes		: Call once at boot after configure_twi.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_shadow_init(void)
+{
+     memset(shadow_dirty, 0, sizeof(shadow_dirty));
+     memset(&shadow_stats, 0, sizeof(shadow_stats));
+     shadow_wr_busy = 0;
+     shadow_scan = 0;
+
+     return eeprom_read_frame(0x0000, shadow_mem, EEPROM_USER_SIZE);
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_shadow_read_byte(uint16_t addr)
+* Returns		: uint8_t ---> Byte at addr, 0xFF outside the user area.
+* Arguments		: uint16_t addr
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Drop in for eeprom_read_byte without a bus transfer.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_shadow_read_byte(uint16_t addr)
+{
+     return (addr < EEPROM_USER_SIZE) ? shadow_mem[addr] : 0xFF;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_shadow_read(uint16_t address, uint8_t *data, uint16_t length)
+* Returns		: uint8_t ---> EEPROM_OK or EEPROM_ERR_RANGE.
+* Arguments		: uint16_t address, uint8_t *data, uint16_t length
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Drop in for eeprom_read_frame without a bus transfer.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_shadow_read(uint16_t address, uint8_t *data, uint16_t length)
+{
+     if (((uint32_t)address + length) > EEPROM_USER_SIZE)
+     {
+          return EEPROM_ERR_RANGE;
+     }
+     memcpy(data, &shadow_mem[address], length);
+     return EEPROM_OK;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_shadow_write_byte(uint16_t addr, uint8_t data)
+* Returns		: uint8_t ---> EEPROM_OK or EEPROM_ERR_RANGE.
+* Arguments		: uint16_t addr, uint8_t data
+* Created by	: Anup Silvan Mascarenhas
+* Description	: NA
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_shadow_write_byte(uint16_t addr, uint8_t data)
+{
+     return eeprom_shadow_write(addr, &data, 1);
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_shadow_write(uint16_t address, const uint8_t *data, uint16_t length)
+* Returns		: uint8_t ---> EEPROM_OK or EEPROM_ERR_RANGE.
+* Arguments		: uint16_t address, const uint8_t *data, uint16_t length
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Updates the mirror. Only pages where a byte really changes
+*				  are marked dirty.
+*              :
+* Notes		: The device is written later by the flusher.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_shadow_write(uint16_t address, const uint8_t *data, uint16_t length)
+{
+     uint8_t changed = 0;
+
+     if (((uint32_t)address + length) > EEPROM_USER_SIZE)
+     {
+          return EEPROM_ERR_RANGE;
+     }
+
+     for (uint16_t idx = 0; idx < length; idx++)
+     {
+          if (shadow_mem[address + idx] != data[idx])
+          {
+               shadow_mem[address + idx] = data[idx];
+               shadow_mark_dirty((address + idx) / PAGE_SIZE);
+               changed = 1;
+          }
+     }
+
+     if (changed)
+     {
+          shadow_stats.writes++;
+     }
+     else
+     {
+          shadow_stats.writes_unchanged++;
+     }
+     return EEPROM_OK;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_shadow_flush_task(void)
+* Returns		: uint8_t ---> EEPROM_OK when every page is committed,
+*				  EEPROM_BUSY while pages are pending, else the error of the
+*				  last page write (the page stays dirty and is retried).
+* Arguments		: None
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Call from the main loop when idle. While a write cycle runs
+*				  it sends one address probe and returns; otherwise it starts
+*				  the write of the next dirty page.
+*              :
+* Notes		: Direct ext_eeprom.c accesses must wait till it returns
+*				  EEPROM_OK, the device does not answer during its write cycles.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_shadow_flush_task(void)
+{
+     uint16_t page;
+     uint8_t sts;
+
+     if (shadow_wr_busy)
+     {
+          if (twi_bus_probe(EEPROM_ADDR) == TWI_SUCCESS)
+          {
+               pio_set(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);
+               shadow_wr_busy = 0;
+               shadow_stats.pages_flushed++;
+          }
+          else if (++shadow_polls >= EEPROM_ACK_POLL_MAX)
+          {
+               pio_set(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);
+               shadow_wr_busy = 0;
+               shadow_stats.flush_errors++;
+               shadow_mark_dirty(shadow_wr_page);
+               return EEPROM_ERR_TIMEOUT;
+          }
+          else
+          {
+               return EEPROM_BUSY;
+          }
+     }
+
+     page = shadow_next_dirty();
+     if (page >= SHADOW_PAGES)
+     {
+          return EEPROM_OK;
+     }
+
+     /* Clear first, a write to the page during the cycle marks it again */
+     shadow_dirty[page / 32] &= ~(1UL << (page % 32));
+     shadow_stats.dirty_pages--;
+
+     sts = eeprom_start_page_write(page * PAGE_SIZE, &shadow_mem[page * PAGE_SIZE], PAGE_SIZE);
+     if (sts != EEPROM_OK)
+     {
+          shadow_stats.flush_errors++;
+          shadow_mark_dirty(page);
+          return sts;
+     }
+
+     shadow_wr_page = page;
+     shadow_wr_busy = 1;
+     shadow_polls = 0;
+     shadow_scan = (page + 1) % SHADOW_PAGES;
+     return EEPROM_BUSY;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_shadow_flush(void)
+* Returns		: uint8_t ---> EEPROM_OK, else the first page write error.
+* Arguments		: None
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Commits every dirty page before returning (before a reset or
+*				  power down).
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_shadow_flush(void)
+{
+     uint8_t sts;
+
+     while ((sts = eeprom_shadow_flush_task()) == EEPROM_BUSY);
+     return sts;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_shadow_is_dirty(uint16_t page)
+* Returns		: uint8_t ---> 1 if the page waits to be written.
+* Arguments		: uint16_t page ---> 0 to SHADOW_PAGES - 1.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: NA
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_shadow_is_dirty(uint16_t page)
+{
+     return (page < SHADOW_PAGES) ? ((shadow_dirty[page / 32] >> (page % 32)) & 1) : 0;
+}
+
+/*****************************************************************************
+* Function name	: void eeprom_shadow_get_stats(EEPROM_SHADOW_STATS *stats)
+* Returns		: None
+* Arguments		: EEPROM_SHADOW_STATS *stats ---> Filled with a copy of the counters.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: NA
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+void eeprom_shadow_get_stats(EEPROM_SHADOW_STATS *stats)
+{
+     *stats = shadow_stats;
+}
+
+/*****************************************************************************
+* Function name	: static void shadow_mark_dirty(uint16_t page)
+* Returns		: None
+* Arguments		: uint16_t page
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Sets the dirty bit and keeps the dirty page count.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+static void shadow_mark_dirty(uint16_t page)
+{
+     uint32_t mask = 1UL << (page % 32);
+
+     if (!(shadow_dirty[page / 32] & mask))
+     {
+          shadow_dirty[page / 32] |= mask;
+          shadow_stats.dirty_pages++;
+          if (shadow_stats.dirty_pages > shadow_stats.max_dirty_pages)
+          {
+               shadow_stats.max_dirty_pages = shadow_stats.dirty_pages;
+          }
+     }
+}
+
+/*****************************************************************************
+* Function name	: static uint16_t shadow_next_dirty(void)
+* Returns		: uint16_t ---> Next dirty page from shadow_scan on, SHADOW_PAGES
+*				  if none.
+* Arguments		: None
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Searches the bitmap a word at a time, wrapping once.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+static uint16_t shadow_next_dirty(void)
+{
+     uint16_t word = shadow_scan / 32;
+     uint32_t bits = shadow_dirty[word] & (0xFFFFFFFFUL << (shadow_scan % 32));
+
+     if (shadow_stats.dirty_pages == 0)
+     {
+          return SHADOW_PAGES;
+     }
+
+     for (uint16_t cnt = 0; cnt <= (SHADOW_PAGES / 32); cnt++)
+     {
+          if (bits)
+          {
+               return (word * 32) + __builtin_ctz(bits);
+          }
+          word = (word + 1) % (SHADOW_PAGES / 32);
+          bits = shadow_dirty[word];
+     }
+     return SHADOW_PAGES;
+}
@@ -0,0 +1,45 @@
+/*****************************************************************************
+*                      
+*
+* Module Name	: eeprom_shadow.h
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Header file for eeprom_shadow.c
+*				  Defines the RAM mirror of the external EEPROM.
+*
+*
+****************************************************************************/
+
+#ifndef EEPROM_SHADOW_H_
+#define EEPROM_SHADOW_H_
+
+#include "ext_eeprom.h"
+
+#define SHADOW_PAGES          (EEPROM_USER_SIZE / PAGE_SIZE)                    // 192 pages of 32 bytes, the config store is not mirrored.
+
+#if (SHADOW_PAGES % 32) || (SHADOW_PAGES == 0)
+#error "EEPROM_USER_SIZE must be a multiple of 32 pages"
+#endif
+
+typedef struct
+{
+     uint32_t pages_flushed;                                                    // Page writes done by the flusher.
+     uint32_t writes;                                                           // eeprom_shadow_write calls that changed data.
+     uint32_t writes_unchanged;                                                 // eeprom_shadow_write calls with identical data.
+     uint32_t flush_errors;                                                     // Page writes that failed or timed out.
+     uint16_t dirty_pages;                                                      // Pages waiting to be written now.
+     uint16_t max_dirty_pages;                                                  // Highest dirty_pages seen.
+} EEPROM_SHADOW_STATS;
+
+// Function prototypes
+uint8_t eeprom_shadow_init(void);
+uint8_t eeprom_shadow_read_byte(uint16_t addr);
+uint8_t eeprom_shadow_read(uint16_t address, uint8_t *data, uint16_t length);
+uint8_t eeprom_shadow_write_byte(uint16_t addr, uint8_t data);
+uint8_t eeprom_shadow_write(uint16_t address, const uint8_t *data, uint16_t length);
+uint8_t eeprom_shadow_flush_task(void);
+uint8_t eeprom_shadow_flush(void);
+uint8_t eeprom_shadow_is_dirty(uint16_t page);
+void eeprom_shadow_get_stats(EEPROM_SHADOW_STATS *stats);
+
+#endif /* EEPROM_SHADOW_H_ */
@@ -17,11 +17,46 @@
 #include "asf.h"
 #include "user_uart.h"
 #include "twi.h"
+#include "user_i2c.h"
+#include "string.h"
 
 /* User Includes */
 #include "ext_eeprom.h"
 #include "definitions.h"
 
+/* Local definitions */
+#define ERASE_IDLE            (0)                                               // No fill running.
+#define ERASE_WRITE           (1)                                               // Next page write to be sent.
+#define ERASE_POLL            (2)                                               // Write cycle running, probing for the end.
+
+/* Local variables */
+static EEPROM_WR_STATS wr_stats;                                                // Write cycle / ACK polling counters.
+static struct
+{
+     uint16_t next;                                                             // Next address to fill.
+     uint16_t end;                                                              // One past the last address.
+     uint32_t polls;                                                            // Probes of the running write cycle.
+     uint8_t state;
+     uint8_t page[PAGE_SIZE];                                                   // One page of the fill pattern.
+} erase_job;
+
+static struct
+{
+     const EEPROM_SINK *sink;                                                   // NULL when no dump runs.
+     uint16_t next;                                                             // Next address to read.
+     uint16_t remaining;                                                        // Bytes still to read.
+     uint8_t ready_idx;                                                         // Buffer handed to the sink last.
+     uint16_t rd_len;                                                           // Bytes of the read into buf[ready_idx ^ 1], 0 if none.
+     volatile uint8_t rd_pending;                                               // Read still queued on the bus.
+     volatile uint32_t rd_status;                                               // TWI status of the last read.
+     uint8_t buf[2][EEPROM_DUMP_CHUNK];
+} dump_job;
+
+static uint8_t eeprom_uart_is_busy(void);
+static void eeprom_dump_read_done(U8 *data, U32 len, uint32_t status);
+
+const EEPROM_SINK eeprom_uart_sink = {Send_Frame_On_UART, eeprom_uart_is_busy};
+
 /*****************************************************************************
 * Function name	: void eeprom_pin_config(void)
 * Returns		: None
@@ -36,67 +71,112 @@ void eeprom_pin_config(void)
 {
      // Disable the WP (Write Protection Pin).
      pio_set_output(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN, LOW, DISABLE, ENABLE);
+
+     // AT24C64 runs at 400 kHz, the transfers switch the bus clock for it.
+     twi_bus_register_device(EEPROM_ADDR, EEPROM_TWI_SPEED);
+     twi_bus_register_device(EEPROM_EUI_ADDR, EEPROM_TWI_SPEED);
 }
 
 /*****************************************************************************
-* Function name	: void configure_twi(void)
-* Returns		: None
-* Arguments		: None
+* Function name	: uint8_t eeprom_start_page_write(uint16_t address, uint8_t *data, uint16_t length)
+* Returns		: uint8_t ---> EEPROM_OK or EEPROM_ERR_BUS.
+* Arguments		: uint16_t address, uint8_t *data, uint16_t length (inside one page)
 * Created by	: Anup Silvan Mascarenhas
-* Description	: Initialize TWI driver with I2C bus clock set to 100kHz.
+* Description	: Releases write protection and sends one page write. The write
+*				  cycle is left running.
 *              :
-* Notes		: NA
+* Notes		: On success the caller waits for the cycle (eeprom_wait_ready or
+*			  probing) and sets WP again. Every write cycle is started here and
+*			  counted in the write statistics.
 * Global Variables Affected : NA
 *****************************************************************************/
-void configure_twi(void)
+uint8_t eeprom_start_page_write(uint16_t address, uint8_t *data, uint16_t length)
 {
-     /* Initialize TWI driver with I2C bus clock set to 100kHz. */
-     twi_options_t opt;
-     opt.master_clk = sysclk_get_cpu_hz();
-     opt.speed = 100000;
-     if(twi_master_setup(TWI0, &opt) != TWI_SUCCESS)
+     twi_packet_t packet =
+     {
+          .chip = EEPROM_ADDR,                                                  // Chip address.
+          .addr[0] = (address >> 8) & 0xFF,                                     // EEPROM address MSB.
+          .addr[1] = address & 0xFF,                                            // EEPROM address LSB.
+          .addr_length = 2,                                                     // 2-byte address.
+          .buffer = data,                                                       // Data buffer to write.
+          .length = length                                                      // Number of bytes to write.
+     };
+
+     pio_clear(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);
+     if(twi_bus_write(&packet) != TWI_SUCCESS)
      {
+          pio_set(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);
 
           #if DEBUG_ALL || DEBUG_EXT_EEPROM
-          Print_Message("\nTWI initialization failed.");
+          Print_Message("\nFailed to write frame of data to eeprom's specified memory address.");
           #endif
-
+          return EEPROM_ERR_BUS;
      }
+     wr_stats.write_cycles++;
+     return EEPROM_OK;
 }
 
 /*****************************************************************************
-* Function name	: void eeprom_write_byte(uint16_t addr, uint8_t data)
-* Returns		: None
-* Arguments		: uint16_t addr, uint8_t data
+* Function name	: uint8_t eeprom_wait_ready(void)
+* Returns		: uint8_t ---> EEPROM_OK, or EEPROM_ERR_TIMEOUT.
+* Arguments		: None
 * Created by	: Anup Silvan Mascarenhas
-* Description	: Writes 1 byte of data to specified memory address.
+* Description	: Acknowledge polling. The device does not acknowledge its
+*				  address while the internal write cycle runs, so the address is
+*				  probed till it acknowledges or EEPROM_ACK_POLL_MAX is reached.
 *              :
-* Notes		: NA
+* Notes		: twi_probe sends one dummy byte with no word address, which the
+*			  AT24C64 takes as an incomplete address and does not write.
 * Global Variables Affected : NA
 *****************************************************************************/
-void eeprom_write_byte(uint16_t addr, uint8_t data)
+uint8_t eeprom_wait_ready(void)
 {
-     // Configure the Packet to write.
-     twi_package_t packet_tx =
+     uint32_t polls = 0;
+
+     while (twi_bus_probe(EEPROM_ADDR) != TWI_SUCCESS)
      {
-          .addr[0] = addr >> 8,
-          .addr[1] = addr & 0xFF,
-          .addr_length = 2,
-          .buffer = &data,
-          .chip = EEPROM_ADDR,
-          .length = 1
-     };
-     // Write the configured packet.
-     pio_clear(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);
-     if(twi_master_write(TWI0, &packet_tx) != TWI_SUCCESS)
+          if (++polls >= EEPROM_ACK_POLL_MAX)
+          {
+               wr_stats.polls += polls;
+               wr_stats.timeouts++;
+
+               #if DEBUG_ALL || DEBUG_EXT_EEPROM
+               Print_Message("\nEEPROM write cycle did not complete.");
+               #endif
+
+               return EEPROM_ERR_TIMEOUT;
+          }
+     }
+
+     wr_stats.polls += polls;
+     if (polls > wr_stats.max_polls)
      {
+          wr_stats.max_polls = polls;
+     }
+     return EEPROM_OK;
+}
 
-          #if DEBUG_ALL || DEBUG_EXT_EEPROM
-          Print_Message("\nFailed to write 1 byte of data to eeprom's specified memory address.");
-          #endif
+/*****************************************************************************
+* Function name	: uint8_t eeprom_write_byte(uint16_t addr, uint8_t data)
+* Returns		: uint8_t ---> EEPROM_OK, EEPROM_ERR_BUS or EEPROM_ERR_TIMEOUT.
+* Arguments		: uint16_t addr, uint8_t data
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Writes 1 byte of data to specified memory address and waits
+*				  for the write cycle to finish.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_write_byte(uint16_t addr, uint8_t data)
+{
+     uint8_t sts = eeprom_start_page_write(addr, &data, 1);
 
+     if (sts == EEPROM_OK)
+     {
+          sts = eeprom_wait_ready();
+          pio_set(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);                       // Protect again once the write cycle is over.
      }
-     pio_set(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);
+     return sts;
 }
 
 /*****************************************************************************
@@ -123,7 +203,7 @@ uint8_t eeprom_read_byte(uint16_t addr)
           .length = 1
      };
      // Read the configured packet.
-     if(twi_master_read(TWI0, &packet_rx) != TWI_SUCCESS)
+     if(twi_bus_read(&packet_rx) != TWI_SUCCESS)
      {
 
           #if DEBUG_ALL || DEBUG_EXT_EEPROM
@@ -135,56 +215,49 @@ uint8_t eeprom_read_byte(uint16_t addr)
 }
 
 /*****************************************************************************
-* Function name	: void eeprom_write_frame(uint16_t address, uint8_t *data, uint16_t length)
-* Returns		: None
+* Function name	: uint8_t eeprom_write_frame(uint16_t address, uint8_t *data, uint16_t length)
+* Returns		: uint8_t ---> EEPROM_OK, else the first error (the write stops there).
 * Arguments		: uint16_t address, uint8_t *data, uint16_t length
 * Created by	: Anup Silvan Mascarenhas
 * Description	: Writes the data at specified address location in eeprom.
 *              :
-* Notes		: NA
+* Notes		: Data is split at the 32 byte page boundaries of the device. Every
+*			  chunk returns as soon as ACK polling sees the write cycle end.
 * Global Variables Affected : NA
 *****************************************************************************/
-void eeprom_write_frame(uint16_t address, uint8_t *data, uint16_t length)
+uint8_t eeprom_write_frame(uint16_t address, uint8_t *data, uint16_t length)
 {
+     uint8_t sts = EEPROM_OK;
      uint16_t remaining_bytes = length;
      uint16_t bytes_written = 0;
      uint16_t current_address = address;
      while (remaining_bytes > 0)
      {
-          uint16_t bytes_to_write = (remaining_bytes > PAGE_SIZE) ? PAGE_SIZE : remaining_bytes;
+          uint16_t page_room = PAGE_SIZE - (current_address % PAGE_SIZE);      // A write must not run past the end of its page, it would wrap.
+          uint16_t bytes_to_write = (remaining_bytes > page_room) ? page_room : remaining_bytes;
 
-          twi_packet_t packet =
+          sts = eeprom_start_page_write(current_address, &data[bytes_written], bytes_to_write);
+          if (sts == EEPROM_OK)
           {
-               .chip = EEPROM_ADDR,                                             // Chip address.
-               .addr[0] = (current_address >> 8) & 0xFF,                        // EEPROM address MSB.
-               .addr[1] = current_address & 0xFF,                               // EEPROM address LSB.
-               .addr_length = 2,                                                // 2-byte address.
-               .buffer = &data[bytes_written],                                  // Data buffer to write.
-               .length = bytes_to_write                                         // Number of bytes to write.
-          };
-
-          pio_clear(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);
-          if(twi_master_write(TWI0, &packet) != TWI_SUCCESS)
-          {
-
-               #if DEBUG_ALL || DEBUG_EXT_EEPROM
-               Print_Message("\nFailed to write frame of data to eeprom's specified memory address.");
-               #endif
+               sts = eeprom_wait_ready();
+               pio_set(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);
+          }
 
+          if (sts != EEPROM_OK)
+          {
+               break;
           }
-          pio_set(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);
 
           remaining_bytes -= bytes_to_write;
           bytes_written += bytes_to_write;
           current_address += bytes_to_write;
-          delay_ms(2);
-          // Delay or other handling may be necessary depending on EEPROM write time.
      }
+     return sts;
 }
 
 /*****************************************************************************
-* Function name	: void eeprom_read_frame(uint16_t address, uint8_t *data, uint16_t length)
-* Returns		: None
+* Function name	: uint8_t eeprom_read_frame(uint16_t address, uint8_t *data, uint16_t length)
+* Returns		: uint8_t ---> EEPROM_OK or EEPROM_ERR_BUS.
 * Arguments		: uint16_t address, uint8_t *data, uint16_t length
 * Created by	: Anup Silvan Mascarenhas
 * Description	: Reads the data from specified address location from eeprom.
@@ -192,7 +265,7 @@ void eeprom_write_frame(uint16_t address, uint8_t *data, uint16_t length)
 * Notes		: NA
 * Global Variables Affected : NA
 *****************************************************************************/
-void eeprom_read_frame(uint16_t address, uint8_t *data, uint16_t length)
+uint8_t eeprom_read_frame(uint16_t address, uint8_t *data, uint16_t length)
 {
      twi_packet_t packet =
      {
@@ -204,39 +277,401 @@ void eeprom_read_frame(uint16_t address, uint8_t *data, uint16_t length)
           .length = length                                                      // Number of bytes to read.
      };
 
-     if(twi_master_read(TWI0, &packet) != TWI_SUCCESS)
+     if(twi_bus_read(&packet) != TWI_SUCCESS)
      {
 
           #if DEBUG_ALL || DEBUG_EXT_EEPROM
           Print_Message("\nFailed to read frame of data from eeprom's specified memory address.");
           #endif
+          return EEPROM_ERR_BUS;
+     }
+     return EEPROM_OK;
+}
 
+/*****************************************************************************
+* Function name	: uint8_t eeprom_read_frame_async(uint16_t address, uint8_t *data, uint16_t length, TWI_BUS_CB cb)
+* Returns		: uint8_t ---> EEPROM_OK if queued, EEPROM_ERR_RANGE, or
+*				  EEPROM_BUSY when the TWI queue is full.
+* Arguments		: uint16_t address, uint8_t *data, uint16_t length
+*				  TWI_BUS_CB cb ---> Called from TWI0_Handler with the result.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Queues the read on the TWI bus and returns at once, the CPU
+*				  and the other TWI users are not held for the transfer.
+*              :
+* Notes		: data is valid only after the callback reports TWI_SUCCESS.
+*				  Not during a write cycle (the device does not answer).
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_read_frame_async(uint16_t address, uint8_t *data, uint16_t length, TWI_BUS_CB cb)
+{
+     twi_packet_t packet =
+     {
+          .chip = EEPROM_ADDR,                                                  // Chip address.
+          .addr[0] = (address >> 8) & 0xFF,                                     // EEPROM address MSB.
+          .addr[1] = address & 0xFF,                                            // EEPROM address LSB.
+          .addr_length = 2,                                                     // 2-byte address.
+          .buffer = data,                                                       // Data buffer to read into.
+          .length = length                                                      // Number of bytes to read.
+     };
+
+     if ((length == 0) || (((uint32_t)address + length) > DATA_SIZE))
+     {
+          return EEPROM_ERR_RANGE;
      }
+     return (twi_bus_read_async(&packet, cb) == TWI_BUS_OK) ? EEPROM_OK : EEPROM_BUSY;
 }
 
 /*****************************************************************************
-* Function name	: void erase_eeprom(void)
-* Returns		: None
+* Function name	: uint8_t eeprom_update_frame(uint16_t address, uint8_t *data, uint16_t length)
+* Returns		: uint8_t ---> EEPROM_OK, else the first error (the update stops there).
+* Arguments		: uint16_t address, uint8_t *data, uint16_t length
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Same result as eeprom_write_frame, but every page is read back
+*				  first. Pages that already hold the data are skipped, and for the
+*				  others only the span from the first to the last changed byte is
+*				  written, so a config save costs the fewest write cycles.
+*              :
+* Notes		: If the read back fails the whole page chunk is written.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_update_frame(uint16_t address, uint8_t *data, uint16_t length)
+{
+     uint8_t sts = EEPROM_OK;
+     uint8_t page[PAGE_SIZE];
+     uint16_t done = 0;
+
+     while ((done < length) && (sts == EEPROM_OK))
+     {
+          uint16_t current_address = address + done;
+          uint16_t page_room = PAGE_SIZE - (current_address % PAGE_SIZE);
+          uint16_t chunk = ((length - done) > page_room) ? page_room : (length - done);
+          uint16_t first = 0;
+          uint16_t last = chunk - 1;
+
+          if (eeprom_read_frame(current_address, page, chunk) == EEPROM_OK)
+          {
+               while ((first < chunk) && (page[first] == data[done + first]))
+               {
+                    first++;
+               }
+               if (first == chunk)
+               {
+                    wr_stats.pages_skipped++;                                  // Page already holds the data.
+                    done += chunk;
+                    continue;
+               }
+               while (page[last] == data[done + last])
+               {
+                    last--;
+               }
+          }
+
+          wr_stats.bytes_skipped += chunk - (last - first + 1);
+          sts = eeprom_write_frame(current_address + first, &data[done + first], last - first + 1);
+          done += chunk;
+     }
+     return sts;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_fill_range(uint16_t address, uint16_t length, uint8_t pattern)
+* Returns		: uint8_t ---> EEPROM_OK, EEPROM_ERR_RANGE, else the first write error.
+* Arguments		: uint16_t address ---> First address to fill.
+*				  uint16_t length ---> Number of bytes to fill.
+*				  uint8_t pattern ---> Fill value.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Fills a range with whole page writes (one write cycle per
+*				  32 bytes instead of one per byte).
+*              :
+* Notes		: Blocks till done, use eeprom_erase_start / eeprom_erase_task
+*			  from the main loop for big ranges.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_fill_range(uint16_t address, uint16_t length, uint8_t pattern)
+{
+     uint8_t sts = EEPROM_OK;
+     uint8_t page[PAGE_SIZE];
+     uint16_t done = 0;
+
+     if (((uint32_t)address + length) > DATA_SIZE)
+     {
+          return EEPROM_ERR_RANGE;
+     }
+
+     memset(page, pattern, PAGE_SIZE);
+     while ((done < length) && (sts == EEPROM_OK))
+     {
+          uint16_t page_room = PAGE_SIZE - ((address + done) % PAGE_SIZE);
+          uint16_t chunk = ((length - done) > page_room) ? page_room : (length - done);
+
+          sts = eeprom_write_frame(address + done, page, chunk);
+          done += chunk;
+     }
+     return sts;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t erase_eeprom(void)
+* Returns		: uint8_t ---> EEPROM_OK, else the first error (the erase stops there).
 * Arguments		: None
 * Created by	: Anup Silvan Mascarenhas
-* Description	: Erase the complete eeprom by writing 0x00 at all locations.
+* Description	: Erase the complete eeprom by writing 0xFF at all locations.
+*              :
+* Notes		: Blocks for DATA_SIZE / PAGE_SIZE write cycles. Clears the
+*			  config store as well.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t erase_eeprom(void)
+{
+     return eeprom_fill_range(0x0000, DATA_SIZE, 0xFF);
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_erase_start(uint16_t address, uint16_t length, uint8_t pattern)
+* Returns		: uint8_t ---> EEPROM_OK, EEPROM_BUSY or EEPROM_ERR_RANGE.
+* Arguments		: uint16_t address ---> First address to fill.
+*				  uint16_t length ---> Number of bytes to fill.
+*				  uint8_t pattern ---> Fill value (0xFF to erase).
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Starts an incremental fill. The work is done by
+*				  eeprom_erase_task, one page write per call.
 *              :
 * Notes		: NA
 * Global Variables Affected : NA
 *****************************************************************************/
-void erase_eeprom(void)
+uint8_t eeprom_erase_start(uint16_t address, uint16_t length, uint8_t pattern)
 {
-     uint16_t address = 0x0000;
-     uint8_t zero_data = 0xFF; // Value to write for erasing.
+     if (erase_job.state != ERASE_IDLE)
+     {
+          return EEPROM_BUSY;
+     }
+     if ((length == 0) || (((uint32_t)address + length) > DATA_SIZE))
+     {
+          return EEPROM_ERR_RANGE;
+     }
+
+     memset(erase_job.page, pattern, PAGE_SIZE);
+     erase_job.next = address;
+     erase_job.end = address + length;
+     erase_job.state = ERASE_WRITE;
+     return EEPROM_OK;
+}
 
-     // Iterate through each address in the EEPROM and write zero_data.
-     while (address < DATA_SIZE)
+/*****************************************************************************
+* Function name	: uint8_t eeprom_erase_task(void)
+* Returns		: uint8_t ---> EEPROM_BUSY while the fill runs, EEPROM_OK when it
+*				  is done (or none was started), else the error that ended it.
+* Arguments		: None
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Call from the main loop. Never waits : while a write cycle
+*				  runs it sends one address probe and returns, once the device
+*				  acknowledges it sends the next page.
+*              :
+* Notes		: Other EEPROM accesses must wait till the fill is done, the
+*			  device does not answer during its write cycles.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_erase_task(void)
+{
+     uint8_t sts = EEPROM_OK;
+
+     if (erase_job.state == ERASE_WRITE)
+     {
+          uint16_t page_room = PAGE_SIZE - (erase_job.next % PAGE_SIZE);
+          uint16_t chunk = ((erase_job.end - erase_job.next) > page_room) ? page_room : (erase_job.end - erase_job.next);
+
+          sts = eeprom_start_page_write(erase_job.next, erase_job.page, chunk);
+          if (sts != EEPROM_OK)
+          {
+               erase_job.state = ERASE_IDLE;
+               return sts;
+          }
+          erase_job.next += chunk;
+          erase_job.polls = 0;
+          erase_job.state = ERASE_POLL;
+     }
+     else if (erase_job.state == ERASE_POLL)
+     {
+          if (twi_bus_probe(EEPROM_ADDR) == TWI_SUCCESS)
+          {
+               pio_set(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);
+               wr_stats.polls += erase_job.polls;
+               if (erase_job.polls > wr_stats.max_polls)
+               {
+                    wr_stats.max_polls = erase_job.polls;
+               }
+               erase_job.state = (erase_job.next < erase_job.end) ? ERASE_WRITE : ERASE_IDLE;
+          }
+          else if (++erase_job.polls >= EEPROM_ACK_POLL_MAX)
+          {
+               pio_set(WRITE_PROTECT_PORT, WRITE_PROTECT_PIN);
+               wr_stats.polls += erase_job.polls;
+               wr_stats.timeouts++;
+               erase_job.state = ERASE_IDLE;
+               return EEPROM_ERR_TIMEOUT;
+          }
+     }
+
+     return (erase_job.state == ERASE_IDLE) ? EEPROM_OK : EEPROM_BUSY;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_erase_is_busy(void)
+* Returns		: uint8_t ---> 1 while an incremental fill is running.
+* Arguments		: None
+* Created by	: Anup Silvan Mascarenhas
+* Description	: NA
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_erase_is_busy(void)
+{
+     return (erase_job.state != ERASE_IDLE);
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_dump_start(uint16_t address, uint16_t length, const EEPROM_SINK *sink)
+* Returns		: uint8_t ---> EEPROM_OK, EEPROM_BUSY or EEPROM_ERR_RANGE.
+* Arguments		: uint16_t address ---> First address to dump.
+*				  uint16_t length ---> Number of bytes.
+*				  const EEPROM_SINK *sink ---> Where the bytes go.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Starts a streaming dump, the work is done by eeprom_dump_task.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_dump_start(uint16_t address, uint16_t length, const EEPROM_SINK *sink)
+{
+     if (dump_job.sink != NULL)
+     {
+          return EEPROM_BUSY;
+     }
+     if ((length == 0) || (((uint32_t)address + length) > DATA_SIZE))
+     {
+          return EEPROM_ERR_RANGE;
+     }
+
+     dump_job.next = address;
+     dump_job.remaining = length;
+     dump_job.ready_idx = 1;                                                    // First read goes to buffer 0.
+     dump_job.rd_len = 0;
+     dump_job.rd_pending = 0;
+     dump_job.sink = sink;
+     return EEPROM_OK;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_dump_task(void)
+* Returns		: uint8_t ---> EEPROM_BUSY while the dump runs, EEPROM_OK when done,
+*				  else the read error that ended it.
+* Arguments		: None
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Double buffered : the next chunk is read by the TWI interrupt
+*				  into one buffer while the sink transmits the other. Once the
+*				  read is done and the sink is free the buffers swap, the read
+*				  of the following chunk is queued and then the sink is given
+*				  the chunk just read.
+*              :
+* Notes		: Call from the main loop, or use eeprom_dump.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_dump_task(void)
+{
+     uint16_t send_len = 0;
+
+     if (dump_job.sink == NULL)
+     {
+          return EEPROM_OK;
+     }
+     if (dump_job.rd_pending)
+     {
+          return EEPROM_BUSY;
+     }
+
+     if (dump_job.rd_len > 0)
+     {
+          if (dump_job.rd_status != TWI_SUCCESS)
+          {
+               dump_job.sink = NULL;
+               return EEPROM_ERR_BUS;
+          }
+          if ((dump_job.sink->is_busy != NULL) && dump_job.sink->is_busy())
+          {
+               return EEPROM_BUSY;
+          }
+          dump_job.ready_idx ^= 1;
+          send_len = dump_job.rd_len;
+          dump_job.rd_len = 0;
+     }
+
+     if (dump_job.remaining > 0)
+     {
+          uint16_t len = (dump_job.remaining > EEPROM_DUMP_CHUNK) ? EEPROM_DUMP_CHUNK : dump_job.remaining;
+
+          dump_job.rd_pending = 1;                                              // Queued before send so the read overlaps the transmit.
+          if (eeprom_read_frame_async(dump_job.next, dump_job.buf[dump_job.ready_idx ^ 1], len, eeprom_dump_read_done) == EEPROM_OK)
+          {
+               dump_job.next += len;
+               dump_job.remaining -= len;
+               dump_job.rd_len = len;
+          }
+          else
+          {
+               dump_job.rd_pending = 0;                                         // TWI queue full, retried on the next call.
+          }
+     }
+
+     if (send_len > 0)
+     {
+          dump_job.sink->send(dump_job.buf[dump_job.ready_idx], send_len);
+     }
+
+     if ((dump_job.remaining == 0) && (dump_job.rd_len == 0))
+     {
+          dump_job.sink = NULL;
+          return EEPROM_OK;
+     }
+     return EEPROM_BUSY;
+}
+
+/*****************************************************************************
+* Function name	: uint8_t eeprom_dump(uint16_t address, uint16_t length, const EEPROM_SINK *sink)
+* Returns		: uint8_t ---> EEPROM_OK, else the error of start or task.
+* Arguments		: Same as eeprom_dump_start.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Runs a complete dump before returning.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+uint8_t eeprom_dump(uint16_t address, uint16_t length, const EEPROM_SINK *sink)
+{
+     uint8_t sts = eeprom_dump_start(address, length, sink);
+
+     if (sts != EEPROM_OK)
      {
-          eeprom_write_byte(address, zero_data);
-          address++;
-          delay_ms(2);
-          // Delay or other handling may be necessary depending on EEPROM write time.
+          return sts;
      }
+     while ((sts = eeprom_dump_task()) == EEPROM_BUSY);
+     return sts;
+}
+
+/*****************************************************************************
+* Function name	: static void eeprom_dump_read_done(U8 *data, U32 len, uint32_t status)
+* Returns		: None
+* Arguments		: TWI_BUS_CB arguments.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Completion of a dump chunk read, runs in TWI0_Handler.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+static void eeprom_dump_read_done(U8 *data, U32 len, uint32_t status)
+{
+     dump_job.rd_status = status;
+     dump_job.rd_pending = 0;
 }
 
 /*****************************************************************************
@@ -246,16 +681,13 @@ void erase_eeprom(void)
 * Created by	: Anup Silvan Mascarenhas
 * Description	: Read complete 8192 bytes of EEPROM memory.
 *              :
-* Notes		: NA
+* Notes		: Streams page sized chunks to the debug UART, no 8 KB buffer.
 * Global Variables Affected : NA
 *****************************************************************************/
 void read_cplt_eeprom(void)
 {
-     uint16_t address = 0x0000;                        // First address of eeprom.
-     uint8_t read_data[8192];
-     eeprom_read_frame(address, read_data, 8192);      // Read complete memory of 8192 bytes.
      Print_Message("\nData read : ");
-     Send_Frame_On_UART(read_data, 8192);
+     eeprom_dump(0x0000, DATA_SIZE, &eeprom_uart_sink);                         // Read complete memory of 8192 bytes.
 }
 
 /*****************************************************************************
@@ -290,7 +722,7 @@ void EEPROM_EUI_READ(U8* data)
 		.length = length			// Number of bytes to read.
 	};
 
-	if (twi_master_read(TWI0, &packet) != TWI_SUCCESS)
+	if (twi_bus_read(&packet) != TWI_SUCCESS)
 	{
 
 		#if DEBUG_ALL || DEBUG_EXT_EEPROM
@@ -303,4 +735,90 @@ void EEPROM_EUI_READ(U8* data)
 		Print_Message("\nEUI-48 read successful.");
 		#endif
 	}
-}
\ No newline at end of file
+}
+
+/*****************************************************************************
+* Function name	: static uint8_t eeprom_uart_is_busy(void)
+* Returns		: uint8_t ---> 1 while the debug UART sends the last frame.
+* Arguments		: None
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Busy check of eeprom_uart_sink.
+*              :
+* Notes		: Always 0 with UART_POLLING_EN, Send_Frame_On_UART then blocks.
+* Global Variables Affected : NA
+*****************************************************************************/
+static uint8_t eeprom_uart_is_busy(void)
+{
+     return (gb_uart_ready_f == uRESET);
+}
+
+/*****************************************************************************
+* Function name	: void eeprom_get_wr_stats(EEPROM_WR_STATS *stats)
+* Returns		: None
+* Arguments		: EEPROM_WR_STATS *stats ---> Filled with a copy of the counters.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Gives the write cycle and ACK polling counters.
+*              :
+* Notes		: NA
+* Global Variables Affected : NA
+*****************************************************************************/
+void eeprom_get_wr_stats(EEPROM_WR_STATS *stats)
+{
+     *stats = wr_stats;
+}
+
+#if EEPROM_BENCHMARK_EN
+/*****************************************************************************
+* Function name	: void eeprom_benchmark_write(uint16_t address, uint16_t length)
+* Returns		: None
+* Arguments		: uint16_t address ---> First address of the scratch area.
+*				  uint16_t length ---> Bytes to write.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Times a bulk eeprom_write_frame with the DWT cycle counter and
+*				  prints it next to the time the old fixed 2 ms per chunk delay
+*				  alone would have cost.
+*              :
+* Notes		: Overwrites the scratch area.
+* Global Variables Affected : NA
+*****************************************************************************/
+void eeprom_benchmark_write(uint16_t address, uint16_t length)
+{
+     uint8_t page[PAGE_SIZE];
+     EEPROM_WR_STATS before = wr_stats;
+     uint32_t start, cycles, cycles_per_ms;
+     uint16_t done = 0;
+     uint16_t chunks = 0;
+
+     for (uint8_t idx = 0; idx < PAGE_SIZE; idx++)
+     {
+          page[idx] = idx;
+     }
+
+     CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+     DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+     cycles_per_ms = sysclk_get_cpu_hz() / 1000;
+
+     start = DWT->CYCCNT;
+     while (done < length)
+     {
+          uint16_t len = ((length - done) > PAGE_SIZE) ? PAGE_SIZE : (length - done);
+          eeprom_write_frame(address + done, page, len);
+          done += len;
+          chunks++;
+     }
+     cycles = DWT->CYCCNT - start;
+
+     Print_Message("\nEEPROM bulk write, bytes : ");
+     Print_Number(length);
+     Print_Message(" time us : ");
+     Print_Number((cycles / (cycles_per_ms / 1000)));
+     Print_Message(" fixed delay ms : ");
+     Print_Number(chunks * 2);
+     Print_Message(" polls : ");
+     Print_Number(wr_stats.polls - before.polls);
+     Print_Message(" max polls : ");
+     Print_Number(wr_stats.max_polls);
+     Print_Message(" timeouts : ");
+     Print_Number(wr_stats.timeouts - before.timeouts);
+}
+#endif
@@ -13,6 +13,8 @@
 #ifndef EXT_EEPROM_H_
 #define EXT_EEPROM_H_
 
+#include "user_i2c.h"
+
 #define WRITE_PROTECT_PORT    (PIOA)                                            // Port of pin used for write protect in eeprom.
 #define WRITE_PROTECT_PIN     (PIO_PA5)                                         // Pin used for write protect in eeprom.
 
@@ -22,15 +24,77 @@
 #define MAX_FRAME_SIZE        (256)                                             // Maximum frame size to write or read.
 #define DATA_SIZE             (PAGE_SIZE * MAX_FRAME_SIZE)                      // Total data size to write or read.
 
+#ifndef EEPROM_USER_SIZE
+#define EEPROM_USER_SIZE      (DATA_SIZE - 0x0800)                              // Bytes from 0x0000 for frames and eeprom_shadow, the top 2 KB is the config store.
+#endif
+
+#ifndef EEPROM_TWI_SPEED
+#define EEPROM_TWI_SPEED      (400000)                                          // SCL frequency for the EEPROM, 400 kHz fast mode.
+#endif
+
+#ifndef EEPROM_ACK_POLL_MAX
+#define EEPROM_ACK_POLL_MAX   (800)                                             // Address probes before a write cycle is declared stuck (~50 us each at 400 kHz, ~40 ms in all, tWR is 5 ms).
+#endif
+
+#ifndef EEPROM_DUMP_CHUNK
+#define EEPROM_DUMP_CHUNK     (PAGE_SIZE)                                       // Bytes per dump read, fits the 100 byte UART TX buffer.
+#endif
+
+#ifndef EEPROM_BENCHMARK_EN
+#define EEPROM_BENCHMARK_EN   (0)                                               // Build eeprom_benchmark_write.
+#endif
+
+// Return codes
+#define EEPROM_OK             (0)                                               // Transfer done and write cycle finished.
+#define EEPROM_ERR_BUS        (1)                                               // TWI transfer failed (NACK / arbitration).
+#define EEPROM_ERR_TIMEOUT    (2)                                               // Device did not acknowledge within EEPROM_ACK_POLL_MAX probes.
+#define EEPROM_ERR_RANGE      (3)                                               // Range runs past DATA_SIZE.
+#define EEPROM_BUSY           (4)                                               // Incremental fill still running.
+#define EEPROM_ERR_NOT_FOUND  (5)                                               // Config key has no record (eeprom_cfg_store.c).
+
+typedef struct
+{
+     uint32_t write_cycles;                                                     // Write cycles started.
+     uint32_t polls;                                                            // Address probes spent waiting for them.
+     uint32_t max_polls;                                                        // Longest wait in probes.
+     uint32_t timeouts;                                                         // Waits that hit EEPROM_ACK_POLL_MAX.
+     uint32_t pages_skipped;                                                    // Page chunks eeprom_update_frame found unchanged.
+     uint32_t bytes_skipped;                                                    // Unchanged bytes trimmed off written chunks.
+} EEPROM_WR_STATS;
+
+// Byte sink for the streaming dump. send may keep using the buffer till
+// is_busy returns 0; is_busy may be NULL for a sink that blocks in send.
+typedef struct
+{
+     void (*send)(U8 *data, U16 len);
+     uint8_t (*is_busy)(void);
+} EEPROM_SINK;
+
+extern const EEPROM_SINK eeprom_uart_sink;                                      // Debug UART (Send_Frame_On_UART).
+
 // Function prototypes
-void configure_twi(void);
 void eeprom_pin_config(void);
-void eeprom_write_byte(uint16_t addr, uint8_t data);
+uint8_t eeprom_wait_ready(void);
+uint8_t eeprom_start_page_write(uint16_t address, uint8_t *data, uint16_t length);
+uint8_t eeprom_write_byte(uint16_t addr, uint8_t data);
 uint8_t eeprom_read_byte(uint16_t addr);
-void eeprom_write_frame(uint16_t address, uint8_t *data, uint16_t length);
-void eeprom_read_frame(uint16_t address, uint8_t *data, uint16_t length);
-void erase_eeprom(void);
+uint8_t eeprom_write_frame(uint16_t address, uint8_t *data, uint16_t length);
+uint8_t eeprom_read_frame(uint16_t address, uint8_t *data, uint16_t length);
+uint8_t eeprom_read_frame_async(uint16_t address, uint8_t *data, uint16_t length, TWI_BUS_CB cb);
+uint8_t eeprom_update_frame(uint16_t address, uint8_t *data, uint16_t length);
+uint8_t eeprom_fill_range(uint16_t address, uint16_t length, uint8_t pattern);
+uint8_t erase_eeprom(void);
+uint8_t eeprom_erase_start(uint16_t address, uint16_t length, uint8_t pattern);
+uint8_t eeprom_erase_task(void);
+uint8_t eeprom_erase_is_busy(void);
+uint8_t eeprom_dump_start(uint16_t address, uint16_t length, const EEPROM_SINK *sink);
+uint8_t eeprom_dump_task(void);
+uint8_t eeprom_dump(uint16_t address, uint16_t length, const EEPROM_SINK *sink);
 void read_cplt_eeprom(void);
 void EEPROM_EUI_READ(U8* data);
+void eeprom_get_wr_stats(EEPROM_WR_STATS *stats);
+#if EEPROM_BENCHMARK_EN
+void eeprom_benchmark_write(uint16_t address, uint16_t length);
+#endif
 
 #endif /* EXT_EEPROM_H_ */
\ No newline at end of file
@@ -4,6 +4,41 @@
 * Created By	: Anup Silvan Mascarenhas
 * Module
 * Description	:	Initialization of two wire interface *i2c*
+*					Every device on the bus registers its maximum clock and all
+*					transfers go through twi_bus_read / twi_bus_write, which
+*					reprogram the TWI0 clock when the target needs another speed.
+*
+*					This module owns TWI0. Transfers are queued and run from
+*					TWI0_Handler byte by byte, a callback is invoked when one
+*					ends and the next queued transfer is started from there.
+*					twi_bus_read / twi_bus_write / twi_bus_probe queue a transfer
+*					and wait for it, for callers that need the data at once.
+*
+*					Transfers of TWI_PDC_MIN_LEN bytes or more move their data
+*					with the TWI PDC. The PDC stops short of the end (2 bytes for
+*					a read, 1 for a write) and the interrupt moves the rest, so
+*					STOP is requested at the right byte as in the datasheet PDC
+*					sequences. The PDC is only reached through the ASF pdc_xxx
+*					calls, which a host build can replace with a model.
+*
+*					A batch is a list of transfers queued as one request : they
+*					run back to back from the interrupt with one callback at the
+*					end. Consecutive reads of the same device whose addresses and
+*					buffers follow each other are merged into one transaction.
+*					The TWI master repeats START only between the internal
+*					address and the data of a read, so that is the only place a
+*					batch can save a STOP / START pair. Every transaction is
+*					counted per device (twi_bus_get_stats).
+*
+*					Every transaction gets a deadline from its length and clock.
+*					twi_bus_check_timeout (1 ms timer tick and the blocking
+*					waits) pends TWI0_Handler once it has passed; the handler
+*					clocks SCL till a stuck slave releases SDA, reinitialises
+*					TWI0 and repeats the transaction up to TWI_BUS_MAX_RETRIES
+*					times. A NACK is never repeated, EEPROM write cycle polling
+*					depends on it. The worst case of a transaction is then
+*					(TWI_BUS_MAX_RETRIES + 1) x (deadline + recovery), the
+*					worst seen is kept in max_cycles of the bus statistics.
 *
 * Controller	: 	ATSAM4S8B
 *					512 KB		Flash.
@@ -13,20 +48,1145 @@
 #include "asf.h"
 #include "user_i2c.h"
 #include "user_uart.h"
+#include "string.h"
+
+/***** Local variables *****/
+static TWI_DEVICE twi_devices[TWI_MAX_DEVICES];
+static U8 twi_device_cnt = 0;
+static U32 twi_cur_speed = 0;				// SCL frequency TWI0 is programmed for.
+
+static TWI_BUS_REQ twi_queue[TWI_BUS_QUEUE_LEN];	// Waiting transfers, twi_queue[twi_head] is on the bus.
+static volatile U8 twi_head = 0;				// Index of the oldest request.
+static volatile U8 twi_count = 0;				// Requests in the queue (active included).
+static volatile U8 twi_active = 0;				// 1 while twi_queue[twi_head] is on the bus.
+static U8 *twi_cur_ptr;							// Next byte of the active transfer.
+static U32 twi_remaining = 0;					// Bytes of the active transfer not yet moved.
+static U8 twi_stop_sent = 0;
+static U8 twi_cur_chip = 0;						// Slave of the active transaction.
+static U8 twi_cur_dir = TWI_BUS_DIR_WRITE;
+static U32 twi_cur_len = 0;						// Data bytes of the active transaction.
+static U32 twi_start_cycles = 0;
+static U8 twi_op_idx = 0;						// First batch operation of the active transaction.
+static U8 twi_op_span = 1;						// Batch operations merged into it.
+static U32 twi_deadline = 0;					// TWI_BUS_CYCLES value the active transaction must end by.
+static U32 twi_first_cycles = 0;				// Start of the first attempt of the active transaction.
+static U8 twi_retry_cnt = 0;					// Attempts of the active transaction repeated so far.
+static volatile U8 twi_timeout_f = 0;			// Set by twi_bus_check_timeout for TWI0_Handler.
+static U32 twi_cycles_per_us = 1;
+static TWI_DEV_STATS twi_other_stats;			// Devices not in twi_devices.
+#if TWI_PDC_EN
+static Pdc *twi_pdc;							// PDC base of TWI0.
+#endif
 
+static volatile U8 twi_sync_done = 0;
+static volatile uint32_t twi_sync_status = TWI_SUCCESS;
+
+static U32 TWI_Speed_For_Device(U8 chip);
+static void TWI_Select_Speed(U8 chip);
+static TWI_DEV_STATS *TWI_Stats_For_Device(U8 chip);
+static U32 TWI_Bus_Iadr(const twi_packet_t *packet);
+static U8 TWI_Bus_Queue(TWI_BUS_REQ *new_req);
+static U8 TWI_Bus_Queue_Packet(twi_packet_t *packet, U8 dir, TWI_BUS_CB cb);
+static void TWI_Bus_Start(void);
+static void TWI_Bus_Finish(uint32_t status);
+static U32 TWI_Bus_Deadline(U32 length, U32 addr_length);
+static uint32_t TWI_Bus_Sync(twi_packet_t *packet, U8 dir);
+static void TWI_Bus_Sync_Done(U8 *data, U32 len, uint32_t status);
+static void TWI_Bus_Sync_Batch_Done(TWI_BUS_OP *ops, U8 count, uint32_t status);
+
+/*****************************************************************************
+* Function name	: void configure_twi(void)
+* Returns		: Nothing.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Configures the TWI0 pins, starts the bus in standard mode
+*					and enables the TWI0 interrupt used by the transfer queue.
+*               :
+* Notes			: Devices raise the speed with twi_bus_register_device.
+* Global Variables Affected : NA.
+*****************************************************************************/
 void configure_twi(void)
 {
 	pmc_enable_periph_clk(ID_TWI0);
+	#if TWI_PDC_EN
+	twi_pdc = twi_get_pdc_base(TWI0);
+	#endif
+	twi_cycles_per_us = sysclk_get_cpu_hz() / 1000000;
+	TWI_BUS_TIMER_INIT();
 
-	// Configure SCL and SDA pins for TWI functionality
-	pio_configure(PIOA, PIO_PERIPH_A, PIO_PA3A_TWD0 | PIO_PA4A_TWCK0, PIO_PULLUP);
-	
-	/* Initialize TWI driver with I2C bus clock set to 100kHz. */
+	/* A slave reset in the middle of a read (brown-out) may still hold SDA. twi_bus_recover
+	   also configures SCL and SDA pins for TWI functionality and sets the bus to 100kHz. */
+	twi_cur_speed = TWI_STD_SPEED;
+	twi_bus_recover();
+
+	twi_head = 0;
+	twi_count = 0;
+	twi_active = 0;
+	twi_retry_cnt = 0;
+	twi_timeout_f = 0;
+
+	NVIC_DisableIRQ(TWI0_IRQn);
+	NVIC_ClearPendingIRQ(TWI0_IRQn);
+	NVIC_SetPriority(TWI0_IRQn, TWI_BUS_IRQ_PRIORITY);
+	NVIC_EnableIRQ(TWI0_IRQn);
+}
+
+/*****************************************************************************
+* Function name	: U8 twi_bus_register_device(U8 chip, U32 max_speed)
+* Returns		: U8 ---> TWI_BUS_OK or TWI_BUS_ERR_FULL.
+* Arguments    	: U8 chip ---> 7 bit slave address.
+*				  U32 max_speed ---> Highest SCL frequency of the device in Hz.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Adds the device to the speed table, or updates it.
+*               :
+* Notes			: Unregistered addresses are accessed at TWI_STD_SPEED.
+* Global Variables Affected : NA.
+*****************************************************************************/
+U8 twi_bus_register_device(U8 chip, U32 max_speed)
+{
+	for (U8 dIdx = 0; dIdx < twi_device_cnt; dIdx ++)
+	{
+		if (twi_devices[dIdx].chip == chip)
+		{
+			twi_devices[dIdx].max_speed = max_speed;
+			return TWI_BUS_OK;
+		}
+	}
+
+	if (twi_device_cnt >= TWI_MAX_DEVICES)
+	{
+		return TWI_BUS_ERR_FULL;
+	}
+
+	twi_devices[twi_device_cnt].chip = chip;
+	twi_devices[twi_device_cnt].max_speed = max_speed;
+	memset(&twi_devices[twi_device_cnt].stats, 0, sizeof(TWI_DEV_STATS));
+	twi_device_cnt ++;
+	return TWI_BUS_OK;
+}
+
+/*****************************************************************************
+* Function name	: uint32_t twi_bus_read(twi_packet_t *packet)
+* Returns		: uint32_t ---> TWI_SUCCESS or the twi_master_read error.
+* Arguments    	: twi_packet_t *packet ---> Same packet as for twi_master_read.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Queues the read and waits for it.
+*               :
+* Notes			: Must not be called from TWI0_Handler or a callback.
+* Global Variables Affected : NA.
+*****************************************************************************/
+uint32_t twi_bus_read(twi_packet_t *packet)
+{
+	return TWI_Bus_Sync(packet, TWI_BUS_DIR_READ);
+}
+
+/*****************************************************************************
+* Function name	: uint32_t twi_bus_write(twi_packet_t *packet)
+* Returns		: uint32_t ---> TWI_SUCCESS or the twi_master_write error.
+* Arguments    	: twi_packet_t *packet ---> Same packet as for twi_master_write.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Queues the write and waits for it.
+*               :
+* Notes			: Must not be called from TWI0_Handler or a callback.
+* Global Variables Affected : NA.
+*****************************************************************************/
+uint32_t twi_bus_write(twi_packet_t *packet)
+{
+	return TWI_Bus_Sync(packet, TWI_BUS_DIR_WRITE);
+}
+
+/*****************************************************************************
+* Function name	: uint32_t twi_bus_probe(U8 chip)
+* Returns		: uint32_t ---> TWI_SUCCESS if the device acknowledged.
+* Arguments    	: U8 chip ---> 7 bit slave address.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Same as twi_probe : writes one 0x00 byte without an internal
+*					address, through the queue and at the speed of the device.
+*               :
+* Notes			: Must not be called from TWI0_Handler or a callback.
+* Global Variables Affected : NA.
+*****************************************************************************/
+uint32_t twi_bus_probe(U8 chip)
+{
+	U8 data = 0;
+	twi_packet_t packet;
+
+	packet.chip = chip;
+	packet.addr[0] = 0;
+	packet.addr_length = 0;
+	packet.buffer = &data;
+	packet.length = 1;
+
+	return TWI_Bus_Sync(&packet, TWI_BUS_DIR_WRITE);
+}
+
+/*****************************************************************************
+* Function name	: U8 twi_bus_read_async(twi_packet_t *packet, TWI_BUS_CB cb)
+* Returns		: U8 ---> TWI_BUS_OK if queued, TWI_BUS_ERR_FULL or TWI_BUS_ERR_ARG.
+* Arguments    	: twi_packet_t *packet ---> Read to queue, copied into the queue.
+*				  TWI_BUS_CB cb ---> Called on completion, may be NULL.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Queues a read and returns immediately.
+*               :
+* Notes			: packet->buffer is valid only after the callback is called.
+* Global Variables Affected : NA.
+*****************************************************************************/
+U8 twi_bus_read_async(twi_packet_t *packet, TWI_BUS_CB cb)
+{
+	return TWI_Bus_Queue_Packet(packet, TWI_BUS_DIR_READ, cb);
+}
+
+/*****************************************************************************
+* Function name	: U8 twi_bus_write_async(twi_packet_t *packet, TWI_BUS_CB cb)
+* Returns		: U8 ---> TWI_BUS_OK if queued, TWI_BUS_ERR_FULL or TWI_BUS_ERR_ARG.
+* Arguments    	: twi_packet_t *packet ---> Write to queue, copied into the queue.
+*				  TWI_BUS_CB cb ---> Called on completion, may be NULL.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Queues a write and returns immediately.
+*               :
+* Notes			: packet->buffer must not change until the callback is called.
+* Global Variables Affected : NA.
+*****************************************************************************/
+U8 twi_bus_write_async(twi_packet_t *packet, TWI_BUS_CB cb)
+{
+	return TWI_Bus_Queue_Packet(packet, TWI_BUS_DIR_WRITE, cb);
+}
+
+/*****************************************************************************
+* Function name	: U8 twi_bus_batch_async(TWI_BUS_OP *ops, U8 count, TWI_BUS_BATCH_CB cb)
+* Returns		: U8 ---> TWI_BUS_OK if queued, TWI_BUS_ERR_FULL or TWI_BUS_ERR_ARG.
+* Arguments    	: TWI_BUS_OP *ops ---> Operations, run in order.
+*				  U8 count ---> Number of operations.
+*				  TWI_BUS_BATCH_CB cb ---> Called once when the batch ends, may be NULL.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Queues the operations as one request. They run back to back
+*					without returning to the main loop; the first error stops
+*					the batch and the rest get the status TWI_BUS_NOT_RUN.
+*               :
+* Notes			: ops is not copied, it must stay valid till the callback.
+*				  Reads merged into one transaction share its status.
+* Global Variables Affected : NA.
+*****************************************************************************/
+U8 twi_bus_batch_async(TWI_BUS_OP *ops, U8 count, TWI_BUS_BATCH_CB cb)
+{
+	TWI_BUS_REQ req;
+
+	memset(&req, 0, sizeof(req));
+	if ((ops == NULL) || (count == 0))
+	{
+		return TWI_BUS_ERR_ARG;
+	}
+	for (U8 oIdx = 0; oIdx < count; oIdx ++)
+	{
+		if ((ops[oIdx].packet.length == 0) || (ops[oIdx].packet.addr_length > 3))
+		{
+			return TWI_BUS_ERR_ARG;
+		}
+		ops[oIdx].status = TWI_BUS_NOT_RUN;
+	}
+
+	req.ops = ops;
+	req.op_count = count;
+	req.batch_cb = cb;
+	req.cb = NULL;
+	return TWI_Bus_Queue(&req);
+}
+
+/*****************************************************************************
+* Function name	: uint32_t twi_bus_batch(TWI_BUS_OP *ops, U8 count)
+* Returns		: uint32_t ---> TWI_SUCCESS, TWI_INVALID_ARGUMENT or the error
+*				  that stopped the batch.
+* Arguments    	: TWI_BUS_OP *ops ---> Operations, run in order.
+*				  U8 count ---> Number of operations.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Queues the batch and waits for it.
+*               :
+* Notes			: Must not be called from TWI0_Handler or a callback.
+* Global Variables Affected : NA.
+*****************************************************************************/
+uint32_t twi_bus_batch(TWI_BUS_OP *ops, U8 count)
+{
+	U8 sts;
+
+	twi_sync_done = 0;
+	while ((sts = twi_bus_batch_async(ops, count, TWI_Bus_Sync_Batch_Done)) == TWI_BUS_ERR_FULL)
+	{
+		twi_bus_check_timeout();
+	}
+	if (sts != TWI_BUS_OK)
+	{
+		return TWI_INVALID_ARGUMENT;
+	}
+
+	while (!twi_sync_done)
+	{
+		twi_bus_check_timeout();
+	}
+	return twi_sync_status;
+}
+
+/*****************************************************************************
+* Function name	: U8 twi_bus_is_busy(void)
+* Returns		: U8 ---> 1 while any transfer is queued or running.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	NA
+*               :
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+U8 twi_bus_is_busy(void)
+{
+	return (twi_count != 0);
+}
+
+/*****************************************************************************
+* Function name	: void twi_bus_wait(void)
+* Returns		: Nothing.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Blocks till every queued transfer has completed.
+*               :
+* Notes			: Must not be called from TWI0_Handler or a callback.
+* Global Variables Affected : NA.
+*****************************************************************************/
+void twi_bus_wait(void)
+{
+	while (twi_count != 0)
+	{
+		twi_bus_check_timeout();
+	}
+}
+
+/*****************************************************************************
+* Function name	: void twi_bus_check_timeout(void)
+* Returns		: Nothing.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Pends TWI0_Handler when the active transaction has passed
+*					its deadline, the handler ends it.
+*               :
+* Notes			: Call in 1ms of timer ISR. The blocking twi_bus_xxx calls
+*				  also call it while they wait.
+* Global Variables Affected : NA.
+*****************************************************************************/
+void twi_bus_check_timeout(void)
+{
+	if ((twi_active) && ((S32)(TWI_BUS_CYCLES() - twi_deadline) > 0))
+	{
+		twi_timeout_f = 1;
+		NVIC_SetPendingIRQ(TWI0_IRQn);
+	}
+}
+
+/*****************************************************************************
+* Function name	: void twi_bus_recover(void)
+* Returns		: Nothing.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Bus clear of the I2C specification : takes SCL and SDA from
+*					TWI0 and, while a slave holds SDA low, sends up to 9 SCL
+*					pulses so it can finish the byte it is sending. A STOP then
+*					resets the state of every slave, the pins go back to TWI0
+*					and TWI0 is reset and set up again at the current speed.
+*               :
+* Notes			: Takes about 100 us. Only with the bus idle, TWI0_Handler
+*				  calls it itself on a timeout.
+* Global Variables Affected : NA.
+*****************************************************************************/
+void twi_bus_recover(void)
+{
 	twi_options_t opt;
-	opt.master_clk = sysclk_get_cpu_hz();   //cpu
-	opt.speed = 100000;
-	if(twi_master_setup(TWI0, &opt) != TWI_SUCCESS)
+
+	TWI0->TWI_IDR = 0xFFFFFFFF;
+	#if TWI_PDC_EN
+	pdc_disable_transfer(twi_pdc, PERIPH_PTCR_RXTDIS | PERIPH_PTCR_TXTDIS);
+	#endif
+
+	pio_configure(PIOA, PIO_INPUT, PIO_PA3A_TWD0, PIO_PULLUP);
+	pio_configure(PIOA, PIO_OUTPUT_1, PIO_PA4A_TWCK0, PIO_OPENDRAIN | PIO_PULLUP);
+	TWI_BUS_RECOVERY_DELAY();
+
+	for (U8 clk = 0; clk < TWI_BUS_RECOVERY_CLOCKS; clk ++)
+	{
+		if (pio_get(PIOA, PIO_INPUT, PIO_PA3A_TWD0))
+		{
+			break;
+		}
+		pio_clear(PIOA, PIO_PA4A_TWCK0);
+		TWI_BUS_RECOVERY_DELAY();
+		pio_set(PIOA, PIO_PA4A_TWCK0);
+		TWI_BUS_RECOVERY_DELAY();
+	}
+
+	/* STOP : SDA rises while SCL is high */
+	pio_clear(PIOA, PIO_PA4A_TWCK0);
+	pio_configure(PIOA, PIO_OUTPUT_0, PIO_PA3A_TWD0, PIO_OPENDRAIN | PIO_PULLUP);
+	TWI_BUS_RECOVERY_DELAY();
+	pio_set(PIOA, PIO_PA4A_TWCK0);
+	TWI_BUS_RECOVERY_DELAY();
+	pio_set(PIOA, PIO_PA3A_TWD0);
+	TWI_BUS_RECOVERY_DELAY();
+
+	pio_configure(PIOA, PIO_PERIPH_A, PIO_PA3A_TWD0 | PIO_PA4A_TWCK0, PIO_PULLUP);
+
+	opt.master_clk = sysclk_get_cpu_hz();
+	opt.speed = twi_cur_speed;
+	if (twi_master_setup(TWI0, &opt) != TWI_SUCCESS)	// Resets TWI0 (SWRST) before the setup.
 	{
 		Print_Message("\nTWI initialization failed.");
 	}
-}
\ No newline at end of file
+	TWI0->TWI_IDR = 0xFFFFFFFF;
+}
+
+/*****************************************************************************
+* Function name	: void TWI0_Handler(void)
+* Returns		: Nothing.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Moves one byte per RXRDY / TXRDY. The STOP of a read is
+*					requested while the last byte is being received, the STOP
+*					of a write once the last byte has left THR, and the transfer
+*					ends on TXCOMP. A NACK ends it with an error.
+*					ENDRX / ENDTX end the PDC part of a long transfer and hand
+*					the remaining bytes to RXRDY / TXRDY.
+*               :
+* Notes			: Also entered through twi_bus_check_timeout, without a TWI0
+*				  status bit, to end a transaction that passed its deadline.
+* Global Variables Affected : NA.
+*****************************************************************************/
+void TWI0_Handler(void)
+{
+	U32 status = TWI0->TWI_SR;					// Reading SR clears NACK and ARBLST.
+
+	status &= TWI0->TWI_IMR;
+
+	if (twi_timeout_f)
+	{
+		twi_timeout_f = 0;
+		if ((twi_active) && ((S32)(TWI_BUS_CYCLES() - twi_deadline) > 0))
+		{
+			TWI_Stats_For_Device(twi_cur_chip)->timeouts ++;
+			twi_bus_recover();
+			TWI_Bus_Finish(TWI_ERROR_TIMEOUT);
+			return;
+		}
+	}
+
+	if (status & TWI_SR_NACK)
+	{
+		TWI_Bus_Finish((twi_cur_dir == TWI_BUS_DIR_READ) ? TWI_RECEIVE_NACK : TWI_SEND_NACK);
+		return;
+	}
+
+	if (status & TWI_SR_ARBLST)
+	{
+		TWI_Bus_Finish(TWI_ARBITRATION_LOST);
+		return;
+	}
+
+	#if TWI_PDC_EN
+	if (status & (TWI_SR_ENDRX | TWI_SR_ENDTX))
+	{
+		/* PDC part done, the CPU moves the last bytes */
+		pdc_disable_transfer(twi_pdc, PERIPH_PTCR_RXTDIS | PERIPH_PTCR_TXTDIS);
+		TWI0->TWI_IDR = TWI_IDR_ENDRX | TWI_IDR_ENDTX;
+		TWI0->TWI_IER = (status & TWI_SR_ENDRX) ? TWI_IER_RXRDY : TWI_IER_TXRDY;
+		return;
+	}
+	#endif
+
+	if (status & TWI_SR_RXRDY)
+	{
+		*twi_cur_ptr ++ = TWI0->TWI_RHR;
+		twi_remaining --;
+
+		if ((twi_remaining == 1) && (!twi_stop_sent))
+		{
+			TWI0->TWI_CR = TWI_CR_STOP;
+			twi_stop_sent = 1;
+		}
+		if (twi_remaining == 0)
+		{
+			TWI0->TWI_IDR = TWI_IDR_RXRDY;
+			TWI0->TWI_IER = TWI_IER_TXCOMP;
+		}
+	}
+
+	if (status & TWI_SR_TXRDY)
+	{
+		if (twi_remaining > 0)
+		{
+			TWI0->TWI_THR = *twi_cur_ptr ++;
+			twi_remaining --;
+		}
+		else
+		{
+			TWI0->TWI_CR = TWI_CR_STOP;
+			TWI0->TWI_IDR = TWI_IDR_TXRDY;
+			TWI0->TWI_IER = TWI_IER_TXCOMP;
+		}
+	}
+
+	if (status & TWI_SR_TXCOMP)
+	{
+		TWI_Bus_Finish(TWI_SUCCESS);
+	}
+}
+
+/*****************************************************************************
+* Function name	: U32 twi_bus_get_speed(void)
+* Returns		: U32 ---> Current SCL frequency in Hz.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	NA
+*               :
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+U32 twi_bus_get_speed(void)
+{
+	return twi_cur_speed;
+}
+
+/*****************************************************************************
+* Function name	: void twi_bus_get_stats(U8 chip, TWI_DEV_STATS *stats)
+* Returns		: Nothing.
+* Arguments    	: U8 chip ---> 7 bit slave address.
+*				  TWI_DEV_STATS *stats ---> Filled with a copy of the counters.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Counters of a registered device, or the shared counters of
+*					all unregistered addresses.
+*               :
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+void twi_bus_get_stats(U8 chip, TWI_DEV_STATS *stats)
+{
+	NVIC_DisableIRQ(TWI0_IRQn);
+	*stats = *TWI_Stats_For_Device(chip);
+	NVIC_EnableIRQ(TWI0_IRQn);
+}
+
+/*****************************************************************************
+* Function name	: void twi_bus_clear_stats(void)
+* Returns		: Nothing.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	NA
+*               :
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+void twi_bus_clear_stats(void)
+{
+	NVIC_DisableIRQ(TWI0_IRQn);
+	for (U8 dIdx = 0; dIdx < twi_device_cnt; dIdx ++)
+	{
+		memset(&twi_devices[dIdx].stats, 0, sizeof(TWI_DEV_STATS));
+	}
+	memset(&twi_other_stats, 0, sizeof(TWI_DEV_STATS));
+	NVIC_EnableIRQ(TWI0_IRQn);
+}
+
+/*****************************************************************************
+* Function name	: void twi_bus_print_stats(void)
+* Returns		: Nothing.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Prints the counters of every registered device and of the
+*					unregistered ones (chip 00) on the debug UART.
+*               :
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+void twi_bus_print_stats(void)
+{
+	U32 cycles_per_us = sysclk_get_cpu_hz() / 1000000;
+
+	for (U8 dIdx = 0; dIdx <= twi_device_cnt; dIdx ++)
+	{
+		TWI_DEV_STATS stats;
+		U8 chip = (dIdx < twi_device_cnt) ? twi_devices[dIdx].chip : 0;
+
+		if (dIdx < twi_device_cnt)
+		{
+			twi_bus_get_stats(chip, &stats);
+		}
+		else
+		{
+			NVIC_DisableIRQ(TWI0_IRQn);
+			stats = twi_other_stats;
+			NVIC_EnableIRQ(TWI0_IRQn);
+		}
+
+		Print_Message("\nTWI chip : ");
+		Print_ASCII_HEX(chip);
+		Print_Message(" txn : ");
+		Print_Number(stats.transactions);
+		Print_Message(" bytes : ");
+		Print_Number(stats.bytes);
+		Print_Message(" nack : ");
+		Print_Number(stats.nacks);
+		Print_Message(" retry : ");
+		Print_Number(stats.retries);
+		Print_Message(" timeout : ");
+		Print_Number(stats.timeouts);
+		Print_Message(" max us : ");
+		Print_Number(stats.max_cycles / cycles_per_us);
+		Print_Message(" bus us : ");
+		Print_Number((U32)(stats.bus_cycles / cycles_per_us));
+	}
+}
+
+/*****************************************************************************
+* Function name	: static U32 TWI_Speed_For_Device(U8 chip)
+* Returns		: U32 ---> SCL frequency to use for the transfer.
+* Arguments    	: U8 chip ---> Target slave address.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Highest speed the target and the board allow. With
+*					TWI_SPEED_PER_DEVICE at 0 the slowest registered device
+*					sets the speed of every transfer.
+*               :
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+static U32 TWI_Speed_For_Device(U8 chip)
+{
+	U32 speed = TWI_BUS_MAX_SPEED;
+	U8 found = 0;
+
+	for (U8 dIdx = 0; dIdx < twi_device_cnt; dIdx ++)
+	{
+		#if TWI_SPEED_PER_DEVICE
+		if (twi_devices[dIdx].chip != chip)
+		{
+			continue;
+		}
+		#endif
+		if (twi_devices[dIdx].max_speed < speed)
+		{
+			speed = twi_devices[dIdx].max_speed;
+		}
+		found = 1;
+	}
+
+	return found ? speed : TWI_STD_SPEED;
+}
+
+/*****************************************************************************
+* Function name	: static void TWI_Select_Speed(U8 chip)
+* Returns		: Nothing.
+* Arguments    	: U8 chip ---> Target slave address.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Reprograms the TWI0 clock only when the speed changes.
+*               :
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+static void TWI_Select_Speed(U8 chip)
+{
+	U32 speed = TWI_Speed_For_Device(chip);
+
+	if (speed != twi_cur_speed)
+	{
+		twi_set_speed(TWI0, speed, sysclk_get_cpu_hz());
+		twi_cur_speed = speed;
+	}
+}
+
+/*****************************************************************************
+* Function name	: static TWI_DEV_STATS *TWI_Stats_For_Device(U8 chip)
+* Returns		: TWI_DEV_STATS * ---> Counters of the device.
+* Arguments    	: U8 chip ---> 7 bit slave address.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	NA
+*               :
+* Notes			: Unregistered addresses share twi_other_stats.
+* Global Variables Affected : NA.
+*****************************************************************************/
+static TWI_DEV_STATS *TWI_Stats_For_Device(U8 chip)
+{
+	for (U8 dIdx = 0; dIdx < twi_device_cnt; dIdx ++)
+	{
+		if (twi_devices[dIdx].chip == chip)
+		{
+			return &twi_devices[dIdx].stats;
+		}
+	}
+	return &twi_other_stats;
+}
+
+/*****************************************************************************
+* Function name	: static U32 TWI_Bus_Iadr(const twi_packet_t *packet)
+* Returns		: U32 ---> Internal address as written to TWI_IADR.
+* Arguments    	: const twi_packet_t *packet
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	NA
+*               :
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+static U32 TWI_Bus_Iadr(const twi_packet_t *packet)
+{
+	U32 iadr = 0;
+
+	for (U8 aIdx = 0; aIdx < packet->addr_length; aIdx ++)
+	{
+		iadr = (iadr << 8) | packet->addr[aIdx];
+	}
+	return iadr;
+}
+
+/*****************************************************************************
+* Function name	: static U8 TWI_Bus_Queue(TWI_BUS_REQ *new_req)
+* Returns		: U8 ---> TWI_BUS_OK if queued, else TWI_BUS_ERR_FULL.
+* Arguments    	: TWI_BUS_REQ *new_req ---> Request to copy into the queue.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Adds the request to the tail of the queue and starts it if
+*					the bus is idle.
+*               :
+* Notes			: TWI0 interrupt is masked while the queue is modified. May be
+*				  called from a callback to chain transfers.
+* Global Variables Affected : NA.
+*****************************************************************************/
+static U8 TWI_Bus_Queue(TWI_BUS_REQ *new_req)
+{
+	NVIC_DisableIRQ(TWI0_IRQn);
+	if (twi_count >= TWI_BUS_QUEUE_LEN)
+	{
+		NVIC_EnableIRQ(TWI0_IRQn);
+		return TWI_BUS_ERR_FULL;
+	}
+
+	twi_queue[(twi_head + twi_count) % TWI_BUS_QUEUE_LEN] = *new_req;
+	twi_count ++;
+
+	if (!twi_active)
+	{
+		TWI_Bus_Start();
+	}
+	NVIC_EnableIRQ(TWI0_IRQn);
+
+	return TWI_BUS_OK;
+}
+
+/*****************************************************************************
+* Function name	: static U8 TWI_Bus_Queue_Packet(twi_packet_t *packet, U8 dir, TWI_BUS_CB cb)
+* Returns		: U8 ---> TWI_BUS_OK if queued, TWI_BUS_ERR_FULL or TWI_BUS_ERR_ARG.
+* Arguments    	: Same as twi_bus_read_async / twi_bus_write_async, dir selects which.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Queues a single transfer.
+*               :
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+static U8 TWI_Bus_Queue_Packet(twi_packet_t *packet, U8 dir, TWI_BUS_CB cb)
+{
+	TWI_BUS_REQ req;
+
+	if ((packet->length == 0) || (packet->addr_length > 3))
+	{
+		return TWI_BUS_ERR_ARG;
+	}
+
+	req.packet = *packet;
+	req.dir = dir;
+	req.cb = cb;
+	req.ops = NULL;
+	req.op_count = 0;
+	req.batch_cb = NULL;
+	return TWI_Bus_Queue(&req);
+}
+
+/*****************************************************************************
+* Function name	: static void TWI_Bus_Start(void)
+* Returns		: Nothing.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Programs the clock, slave and internal address of the request
+*					at the queue head (or of its next batch operation), then
+*					sends START (read) or the first byte (write) and enables the
+*					interrupts that move the rest.
+*               :
+* Notes			: A one byte read needs START and STOP together. A PDC write
+*				  starts when the PDC loads the first byte into THR.
+* Global Variables Affected : NA.
+*****************************************************************************/
+static void TWI_Bus_Start(void)
+{
+	TWI_BUS_REQ *req = &twi_queue[twi_head];
+	twi_packet_t *packet = &req->packet;
+	U8 dir = req->dir;
+	U32 iadr;
+	U32 length;
+
+	if (req->ops != NULL)
+	{
+		packet = &req->ops[twi_op_idx].packet;
+		dir = req->ops[twi_op_idx].dir;
+	}
+	iadr = TWI_Bus_Iadr(packet);
+	length = packet->length;
+	twi_op_span = 1;
+
+	/* Merge the following reads that continue this one in the device and in memory */
+	while ((req->ops != NULL) && (dir == TWI_BUS_DIR_READ) && ((twi_op_idx + twi_op_span) < req->op_count))
+	{
+		TWI_BUS_OP *next = &req->ops[twi_op_idx + twi_op_span];
+
+		if ((next->dir != TWI_BUS_DIR_READ) || (next->packet.chip != packet->chip) ||
+			(next->packet.addr_length != packet->addr_length) ||
+			(TWI_Bus_Iadr(&next->packet) != (iadr + length)) ||
+			((U8 *)next->packet.buffer != ((U8 *)packet->buffer + length)) ||
+			((length + next->packet.length) > TWI_PDC_MX_LEN))
+		{
+			break;
+		}
+		length += next->packet.length;
+		twi_op_span ++;
+	}
+
+	TWI_Select_Speed(packet->chip);
+
+	twi_cur_ptr = (U8 *)packet->buffer;
+	twi_remaining = length;
+	twi_stop_sent = 0;
+	twi_cur_chip = packet->chip;
+	twi_cur_dir = dir;
+	twi_cur_len = length;
+	twi_start_cycles = TWI_BUS_CYCLES();
+	twi_deadline = twi_start_cycles + TWI_Bus_Deadline(length, packet->addr_length);
+	if (twi_retry_cnt == 0)
+	{
+		twi_first_cycles = twi_start_cycles;
+	}
+	twi_active = 1;
+
+	TWI0->TWI_MMR = 0;
+	TWI0->TWI_MMR = TWI_MMR_DADR(packet->chip) |
+					((packet->addr_length << TWI_MMR_IADRSZ_Pos) & TWI_MMR_IADRSZ_Msk) |
+					((dir == TWI_BUS_DIR_READ) ? TWI_MMR_MREAD : 0);
+	TWI0->TWI_IADR = iadr;
+
+	#if TWI_PDC_EN
+	if ((twi_remaining >= TWI_PDC_MIN_LEN) && (twi_remaining <= TWI_PDC_MX_LEN))
+	{
+		pdc_packet_t pdc_pkt;
+		U32 cpu_bytes = (dir == TWI_BUS_DIR_READ) ? 2 : 1;
+
+		pdc_pkt.ul_addr = (U32)twi_cur_ptr;
+		pdc_pkt.ul_size = twi_remaining - cpu_bytes;
+		twi_cur_ptr += pdc_pkt.ul_size;
+		twi_remaining = cpu_bytes;
+
+		if (dir == TWI_BUS_DIR_READ)
+		{
+			pdc_rx_init(twi_pdc, &pdc_pkt, NULL);
+			pdc_enable_transfer(twi_pdc, PERIPH_PTCR_RXTEN);
+			TWI0->TWI_CR = TWI_CR_START;
+			TWI0->TWI_IER = TWI_IER_ENDRX | TWI_IER_NACK | TWI_IER_ARBLST;
+		}
+		else
+		{
+			pdc_tx_init(twi_pdc, &pdc_pkt, NULL);
+			pdc_enable_transfer(twi_pdc, PERIPH_PTCR_TXTEN);
+			TWI0->TWI_IER = TWI_IER_ENDTX | TWI_IER_NACK | TWI_IER_ARBLST;
+		}
+		return;
+	}
+	#endif
+
+	if (dir == TWI_BUS_DIR_READ)
+	{
+		if (twi_remaining == 1)
+		{
+			TWI0->TWI_CR = TWI_CR_START | TWI_CR_STOP;
+			twi_stop_sent = 1;
+		}
+		else
+		{
+			TWI0->TWI_CR = TWI_CR_START;
+		}
+		TWI0->TWI_IER = TWI_IER_RXRDY | TWI_IER_NACK | TWI_IER_ARBLST;
+	}
+	else
+	{
+		TWI0->TWI_THR = *twi_cur_ptr ++;
+		twi_remaining --;
+		TWI0->TWI_IER = TWI_IER_TXRDY | TWI_IER_NACK | TWI_IER_ARBLST;
+	}
+}
+
+/*****************************************************************************
+* Function name	: static void TWI_Bus_Finish(uint32_t status)
+* Returns		: Nothing.
+* Arguments    	: uint32_t status ---> Result of the transaction.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Counts the transaction for its device. A timeout or a lost
+*					arbitration starts it again while retries are left. A batch
+*					continues with its next operation while no error occurred;
+*					otherwise the request is removed, its callback called and
+*					the next queued one started.
+*               :
+* Notes			: The callback may queue new transfers.
+* Global Variables Affected : NA.
+*****************************************************************************/
+static void TWI_Bus_Finish(uint32_t status)
+{
+	TWI_BUS_REQ *req = &twi_queue[twi_head];
+	TWI_DEV_STATS *stats = TWI_Stats_For_Device(twi_cur_chip);
+
+	TWI0->TWI_IDR = 0xFFFFFFFF;
+	#if TWI_PDC_EN
+	pdc_disable_transfer(twi_pdc, PERIPH_PTCR_RXTDIS | PERIPH_PTCR_TXTDIS);	// A NACK can end a transfer in its PDC part.
+	#endif
+	twi_active = 0;
+
+	stats->transactions ++;
+	stats->bus_cycles += (U32)(TWI_BUS_CYCLES() - twi_start_cycles);
+
+	if (((status == TWI_ERROR_TIMEOUT) || (status == TWI_ARBITRATION_LOST)) && (twi_retry_cnt < TWI_BUS_MAX_RETRIES))
+	{
+		twi_retry_cnt ++;
+		stats->retries ++;
+		TWI_Bus_Start();
+		return;
+	}
+	twi_retry_cnt = 0;
+	if ((U32)(TWI_BUS_CYCLES() - twi_first_cycles) > stats->max_cycles)
+	{
+		stats->max_cycles = (U32)(TWI_BUS_CYCLES() - twi_first_cycles);
+	}
+
+	if (status == TWI_SUCCESS)
+	{
+		stats->bytes += twi_cur_len;
+	}
+	else if ((status == TWI_RECEIVE_NACK) || (status == TWI_SEND_NACK))
+	{
+		stats->nacks ++;
+	}
+
+	if (req->ops != NULL)
+	{
+		for (U8 oIdx = 0; oIdx < twi_op_span; oIdx ++)
+		{
+			req->ops[twi_op_idx + oIdx].status = status;
+		}
+		twi_op_idx += twi_op_span;
+
+		if ((status == TWI_SUCCESS) && (twi_op_idx < req->op_count))
+		{
+			TWI_Bus_Start();
+			return;
+		}
+	}
+
+	TWI_BUS_REQ done = *req;
+	twi_head = (twi_head + 1) % TWI_BUS_QUEUE_LEN;
+	twi_count --;
+	twi_op_idx = 0;
+
+	if ((done.ops != NULL) && (done.batch_cb != NULL))
+	{
+		done.batch_cb(done.ops, done.op_count, status);
+	}
+	else if (done.cb != NULL)
+	{
+		done.cb((U8 *)done.packet.buffer, done.packet.length, status);
+	}
+
+	if ((!twi_active) && (twi_count != 0))
+	{
+		TWI_Bus_Start();
+	}
+}
+
+/*****************************************************************************
+* Function name	: static U32 TWI_Bus_Deadline(U32 length, U32 addr_length)
+* Returns		: U32 ---> TWI_BUS_CYCLES the transaction may take.
+* Arguments    	: U32 length ---> Data bytes.
+*				  U32 addr_length ---> Internal address bytes.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	9 clocks per byte (slave address, internal address, repeated
+*					START address of a read, data) at the current speed plus
+*					TWI_BUS_TIMEOUT_MARGIN_US.
+*               :
+* Notes			: Below 2^31 cycles for any length up to TWI_PDC_MX_LEN.
+* Global Variables Affected : NA.
+*****************************************************************************/
+static U32 TWI_Bus_Deadline(U32 length, U32 addr_length)
+{
+	U32 bits = (length + addr_length + 2) * 9;
+
+	return (bits * ((twi_cycles_per_us * 1000000) / twi_cur_speed)) + (TWI_BUS_TIMEOUT_MARGIN_US * twi_cycles_per_us);
+}
+
+/*****************************************************************************
+* Function name	: static uint32_t TWI_Bus_Sync(twi_packet_t *packet, U8 dir)
+* Returns		: uint32_t ---> TWI_SUCCESS, TWI_INVALID_ARGUMENT or the
+*				  status of the transfer.
+* Arguments    	: twi_packet_t *packet ---> Transfer to run.
+*				  U8 dir ---> TWI_BUS_DIR_WRITE or TWI_BUS_DIR_READ.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Queues the transfer behind the pending ones and waits for its
+*					callback. Waits for a free queue entry if the queue is full.
+*               :
+* Notes			: Main loop only, one synchronous transfer at a time.
+* Global Variables Affected : NA.
+*****************************************************************************/
+static uint32_t TWI_Bus_Sync(twi_packet_t *packet, U8 dir)
+{
+	U8 sts;
+
+	twi_sync_done = 0;
+	while ((sts = TWI_Bus_Queue_Packet(packet, dir, TWI_Bus_Sync_Done)) == TWI_BUS_ERR_FULL)
+	{
+		twi_bus_check_timeout();
+	}
+	if (sts != TWI_BUS_OK)
+	{
+		return TWI_INVALID_ARGUMENT;
+	}
+
+	while (!twi_sync_done)
+	{
+		twi_bus_check_timeout();
+	}
+	return twi_sync_status;
+}
+
+/*****************************************************************************
+* Function name	: static void TWI_Bus_Sync_Done(U8 *data, U32 len, uint32_t status)
+* Returns		: Nothing.
+* Arguments    	: TWI_BUS_CB arguments.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Completion callback of TWI_Bus_Sync.
+*               :
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+static void TWI_Bus_Sync_Done(U8 *data, U32 len, uint32_t status)
+{
+	twi_sync_status = status;
+	twi_sync_done = 1;
+}
+
+/*****************************************************************************
+* Function name	: static void TWI_Bus_Sync_Batch_Done(TWI_BUS_OP *ops, U8 count, uint32_t status)
+* Returns		: Nothing.
+* Arguments    	: TWI_BUS_BATCH_CB arguments.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Completion callback of twi_bus_batch.
+*               :
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+static void TWI_Bus_Sync_Batch_Done(TWI_BUS_OP *ops, U8 count, uint32_t status)
+{
+	twi_sync_status = status;
+	twi_sync_done = 1;
+}
+
+#if TWI_BENCHMARK_EN
+/*****************************************************************************
+* Function name	: void twi_bus_benchmark(void)
+* Returns		: Nothing.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Times an EEPROM page read (0x50, 32 bytes) and an RTC time
+*					read (0x68, 7 bytes) at standard and fast mode with the DWT
+*					cycle counter and prints the average time per transaction.
+*               :
+* Notes			: Only reads, the devices are not changed. The registered
+*				  speeds are restored afterwards.
+* Global Variables Affected : NA.
+*****************************************************************************/
+void twi_bus_benchmark(void)
+{
+	const U32 speeds[2] = {TWI_STD_SPEED, TWI_FAST_SPEED};
+	const U8 chips[2] = {0x50, 0x68};
+	const U8 lengths[2] = {32, 7};
+	TWI_DEVICE saved[TWI_MAX_DEVICES];
+	U8 saved_cnt = twi_device_cnt;
+	U8 buf[32];
+	U32 cycles_per_us = sysclk_get_cpu_hz() / 1000000;
+
+	for (U8 dIdx = 0; dIdx < saved_cnt; dIdx ++)
+	{
+		saved[dIdx] = twi_devices[dIdx];
+	}
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	for (U8 sIdx = 0; sIdx < 2; sIdx ++)
+	{
+		for (U8 cIdx = 0; cIdx < 2; cIdx ++)
+		{
+			twi_packet_t packet;
+			U32 start, cycles;
+
+			twi_bus_register_device(chips[cIdx], speeds[sIdx]);
+			packet.chip = chips[cIdx];
+			packet.addr[0] = 0;
+			packet.addr[1] = 0;
+			packet.addr_length = (chips[cIdx] == 0x50) ? 2 : 1;
+			packet.buffer = buf;
+			packet.length = lengths[cIdx];
+
+			start = DWT->CYCCNT;
+			for (U8 rIdx = 0; rIdx < 16; rIdx ++)
+			{
+				twi_bus_read(&packet);
+			}
+			cycles = DWT->CYCCNT - start;
+
+			Print_Message("\nTWI bench chip : ");
+			Print_ASCII_HEX(chips[cIdx]);
+			Print_Message(" speed : ");
+			Print_Number(speeds[sIdx]);
+			Print_Message(" us/txn : ");
+			Print_Number((cycles / cycles_per_us) / 16);
+		}
+	}
+
+	twi_device_cnt = saved_cnt;
+	for (U8 dIdx = 0; dIdx < saved_cnt; dIdx ++)
+	{
+		twi_devices[dIdx] = saved[dIdx];
+	}
+}
+#endif
@@ -11,6 +11,141 @@
 
 #include "asf.h"
 
+/***** Bus Speed *****/
+#define TWI_STD_SPEED			100000		// Standard mode, every device supports it.
+#define TWI_FAST_SPEED			400000		// Fast mode.
+
+#ifndef TWI_BUS_MAX_SPEED
+#define TWI_BUS_MAX_SPEED		TWI_FAST_SPEED	// Board limit (pull-ups / bus capacitance).
+#endif
+
+#ifndef TWI_SPEED_PER_DEVICE
+#define TWI_SPEED_PER_DEVICE	(1)			// 1 : clock follows the target device, 0 : slowest registered device for all.
+#endif
+
+#ifndef TWI_MAX_DEVICES
+#define TWI_MAX_DEVICES			(4)
+#endif
+
+#ifndef TWI_BUS_QUEUE_LEN
+#define TWI_BUS_QUEUE_LEN		(8)			// Transfers that can wait for the bus.
+#endif
+
+#ifndef TWI_BUS_IRQ_PRIORITY
+#define TWI_BUS_IRQ_PRIORITY	(3)			// Lower the value highest in the priority.
+#endif
+
+#ifndef TWI_PDC_EN
+#define TWI_PDC_EN				(1)			// Move the data of long transfers with the PDC.
+#endif
+
+#ifndef TWI_PDC_MIN_LEN
+#define TWI_PDC_MIN_LEN			(8)			// Shorter transfers are moved byte by byte by the interrupt.
+#endif
+
+#define TWI_PDC_MX_LEN			(65535 + 2)	// PDC counters are 16 bit, plus the bytes moved by the CPU.
+
+#ifndef TWI_BUS_TIMER_INIT
+#define TWI_BUS_TIMER_INIT()	do { CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; } while (0)
+#endif
+
+#ifndef TWI_BUS_CYCLES
+#define TWI_BUS_CYCLES()		(DWT->CYCCNT)	// Time base of the bus time statistics.
+#endif
+
+#ifndef TWI_BUS_TIMEOUT_MARGIN_US
+#define TWI_BUS_TIMEOUT_MARGIN_US	(2000)		// Added to the wire time of a transaction for its deadline (clock stretching, latency).
+#endif
+
+#ifndef TWI_BUS_MAX_RETRIES
+#define TWI_BUS_MAX_RETRIES		(2)			// Repeats of a transaction ended by a timeout or a lost arbitration.
+#endif
+
+#ifndef TWI_BUS_RECOVERY_DELAY
+#define TWI_BUS_RECOVERY_DELAY()	delay_us(5)	// Half period of the SCL pulses of the bus recovery (100 kHz).
+#endif
+
+#define TWI_BUS_RECOVERY_CLOCKS	(9)			// A slave holding SDA releases it within 9 clocks.
+
+#ifndef TWI_BENCHMARK_EN
+#define TWI_BENCHMARK_EN		(0)			// Build twi_bus_benchmark.
+#endif
+
+/***** Return Codes of twi_bus_register_device / twi_bus_xxx_async *****/
+#define TWI_BUS_OK				0
+#define TWI_BUS_ERR_FULL		1			// Device table or transfer queue full.
+#define TWI_BUS_ERR_ARG			2			// Zero length or address longer than 3 bytes.
+
+#define TWI_BUS_DIR_WRITE		0
+#define TWI_BUS_DIR_READ		1
+
+#define TWI_BUS_NOT_RUN			(0xFF)		// Status of the batch operations after a failed one.
+
+/***** Type Declarations *****/
+/* Called from TWI0_Handler when a transfer ends. status is TWI_SUCCESS or a
+   TWI_xxx error of the ASF driver, data and len are the transfer's. */
+typedef void (*TWI_BUS_CB)(U8 *data, U32 len, uint32_t status);
+
+typedef struct
+{
+	twi_packet_t packet;					// Transfer, the buffer must stay valid till the batch ends.
+	U8 dir;									// TWI_BUS_DIR_WRITE or TWI_BUS_DIR_READ.
+	uint32_t status;						// Result, filled in by the driver.
+}TWI_BUS_OP;
+
+/* Called from TWI0_Handler when a batch ends. status is TWI_SUCCESS or the
+   error of the operation that stopped the batch. */
+typedef void (*TWI_BUS_BATCH_CB)(TWI_BUS_OP *ops, U8 count, uint32_t status);
+
+/***** Structure Declarations *****/
+typedef struct
+{
+	U32 transactions;						// START to STOP sequences sent.
+	U32 bytes;								// Data bytes of the successful ones.
+	U32 nacks;								// Transactions ended by a NACK.
+	U32 retries;							// Transactions sent again after an error.
+	U32 timeouts;							// Transactions that passed their deadline, each followed by a bus recovery.
+	U32 max_cycles;							// Worst TWI_BUS_CYCLES from queue head to result, retries included.
+	U64 bus_cycles;							// TWI_BUS_CYCLES spent from START to the end of the transaction.
+}TWI_DEV_STATS;
+
+typedef struct
+{
+	U8 chip;								// 7 bit slave address.
+	U32 max_speed;							// Highest SCL frequency the device supports.
+	TWI_DEV_STATS stats;
+}TWI_DEVICE;
+
+typedef struct
+{
+	twi_packet_t packet;					// Copy of the caller packet, the buffer is not copied.
+	U8 dir;									// TWI_BUS_DIR_WRITE or TWI_BUS_DIR_READ.
+	TWI_BUS_CB cb;							// Completion callback, may be NULL.
+	TWI_BUS_OP *ops;						// Batch operations, NULL for a single transfer.
+	U8 op_count;
+	TWI_BUS_BATCH_CB batch_cb;				// Completion callback of the batch, may be NULL.
+}TWI_BUS_REQ;
+
+/***** Function Prototypes *****/
 void configure_twi(void);
+U8 twi_bus_register_device(U8 chip, U32 max_speed);
+uint32_t twi_bus_read(twi_packet_t *packet);
+uint32_t twi_bus_write(twi_packet_t *packet);
+uint32_t twi_bus_probe(U8 chip);
+U8 twi_bus_read_async(twi_packet_t *packet, TWI_BUS_CB cb);
+U8 twi_bus_write_async(twi_packet_t *packet, TWI_BUS_CB cb);
+U8 twi_bus_batch_async(TWI_BUS_OP *ops, U8 count, TWI_BUS_BATCH_CB cb);
+uint32_t twi_bus_batch(TWI_BUS_OP *ops, U8 count);
+U8 twi_bus_is_busy(void);
+void twi_bus_wait(void);
+void twi_bus_check_timeout(void);
+void twi_bus_recover(void);
+U32 twi_bus_get_speed(void);
+void twi_bus_get_stats(U8 chip, TWI_DEV_STATS *stats);
+void twi_bus_clear_stats(void);
+void twi_bus_print_stats(void);
+#if TWI_BENCHMARK_EN
+void twi_bus_benchmark(void);
+#endif
 
-#endif /* USER_I2C_H_ */
\ No newline at end of file
+#endif /* USER_I2C_H_ */
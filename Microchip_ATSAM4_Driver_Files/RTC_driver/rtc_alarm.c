@@ -0,0 +1,368 @@
+/*****************************************************************************
+*
+*
+* Module Name	: rtc_alarm.c
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Software alarms for schedules such as door unlock windows
+*				  and report times. Up to RTC_ALARM_MAX alarms (one shot or
+*				  periodic) are kept in a list sorted by time, and only the
+*				  nearest one is programmed into DS1339A alarm 1, so the RTC
+*				  pin interrupts the MCU when a schedule is due instead of
+*				  every second.
+*
+*				  RTC_Alarm_Task compares the list with the software clock
+*				  (rtc_clock.c) and calls the callbacks of the due alarms from
+*				  the main loop. The hardware alarm is the wake up and, as its
+*				  match comes at the start of a DS1339A second, still latches
+*				  the millisecond phase of the clock. An alarm the software
+*				  clock sees due before or after the DS1339A one (drift since
+*				  the last sync) fires within that second.
+*
+* Controller	: 	ATSAM4E16CA-AUR
+*					1024 KB		Flash.
+*					128 KB		RAM.
+*
+*****************************************************************************/
+#include "asf.h"
+#include "rtc_alarm.h"
+#include "rtc_clock.h"
+#include "rtc_calendar.h"
+#include "user_uart.h"
+#include "string.h"
+
+/***** Structure Declarations *****/
+typedef struct
+{
+	U32 epoch;						// Next time the alarm fires.
+	U32 period;						// Seconds between two firings, 0 : one shot.
+	RTC_ALARM_CB cb;				// NULL : entry free.
+}RTC_ALARM;
+
+/***** Local variables *****/
+static RTC_ALARM alm_list[RTC_ALARM_MAX];
+static U8 alm_order[RTC_ALARM_MAX];				// Ids of the active alarms, nearest first.
+static U8 alm_count = 0;
+static U32 alm_hw_epoch = 0;					// Time programmed into alarm 1, 0 : alarm 1 off.
+static U32 alm_hw_retry = 0;					// Second after which a failed programming is tried again.
+static U8 alm_hw_mode = 0;						// RTC_Alarm_Init switched the pin to the alarm interrupt.
+static volatile U8 alm_pin_f = 0;				// Alarm 1 pulled the pin low, flag to clear.
+
+static void RTC_Alarm_Insert(U8 id);
+static void RTC_Alarm_Remove(U8 id);
+static void RTC_Alarm_Program(U32 now);
+
+/*****************************************************************************
+* Function Name  : RTC_Alarm_Init
+* Returns        : U8 ---> RTC_ALARM_OK, else RTC_ALARM_ERR_BUS (programmed
+*                  again by RTC_Alarm_Task).
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Empties the alarm list and switches the DS1339A pin from the
+*                  1 Hz square wave to the alarm interrupt, alarm 1 off.
+*
+* Notes          : Call after RTC_Interrupt_Pin_Configure. gb_rtc_1secInt_triggered_f
+*                  is then set by alarm matches only, not every second.
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Alarm_Init(void)
+{
+	memset(alm_list, 0, sizeof(alm_list));
+	alm_count = 0;
+	alm_hw_epoch = 0;
+	alm_hw_retry = 0;
+	alm_hw_mode = 1;
+
+	if (RTC_Set_Alarm1(NULL) != TWI_SUCCESS)
+	{
+		alm_hw_epoch = 1;			// Differs from "off", RTC_Alarm_Task writes it again.
+		return RTC_ALARM_ERR_BUS;
+	}
+	RTC_Clear_Alarm_Flags();
+	return RTC_ALARM_OK;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Alarm_Add
+* Returns        : U8 ---> RTC_ALARM_OK, RTC_ALARM_ERR_FULL, RTC_ALARM_ERR_ARG
+* Arguments      : U32 epoch ---> First firing, seconds since 1970-01-01. A
+*                  time already past fires on the next RTC_Alarm_Task.
+*                  U32 period ---> Seconds between firings, 0 for one shot.
+*                  RTC_ALARM_CB cb ---> Called from RTC_Alarm_Task.
+*                  U8 *id ---> Receives the alarm id for RTC_Alarm_Cancel, may be NULL.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Inserts the alarm in the sorted list. The DS1339A is
+*                  programmed by the next RTC_Alarm_Task if it is the nearest.
+*
+* Notes          : Main loop only, also from a callback.
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Alarm_Add(U32 epoch, U32 period, RTC_ALARM_CB cb, U8 *id)
+{
+	U8 idx;
+
+	if ((cb == NULL) || (epoch < RTC_CAL_EPOCH_2000))
+	{
+		return RTC_ALARM_ERR_ARG;
+	}
+	for (idx = 0; idx < RTC_ALARM_MAX; idx ++)
+	{
+		if (alm_list[idx].cb == NULL)
+		{
+			break;
+		}
+	}
+	if (idx == RTC_ALARM_MAX)
+	{
+		return RTC_ALARM_ERR_FULL;
+	}
+
+	alm_list[idx].epoch = epoch;
+	alm_list[idx].period = period;
+	alm_list[idx].cb = cb;
+	RTC_Alarm_Insert(idx);
+	if (id != NULL)
+	{
+		*id = idx;
+	}
+	return RTC_ALARM_OK;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Alarm_Cancel
+* Returns        : U8 ---> RTC_ALARM_OK, RTC_ALARM_ERR_ARG for an id not in use.
+* Arguments      : U8 id ---> From RTC_Alarm_Add.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Removes the alarm. A periodic alarm may cancel itself from
+*                  its callback.
+*
+* Notes          : Main loop only.
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Alarm_Cancel(U8 id)
+{
+	if ((id >= RTC_ALARM_MAX) || (alm_list[id].cb == NULL))
+	{
+		return RTC_ALARM_ERR_ARG;
+	}
+	RTC_Alarm_Remove(id);
+	alm_list[id].cb = NULL;
+	return RTC_ALARM_OK;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Alarm_Next
+* Returns        : U32 ---> Time of the nearest alarm, 0 if none is scheduled.
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : NA
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+U32 RTC_Alarm_Next(void)
+{
+	return alm_count ? alm_list[alm_order[0]].epoch : 0;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Alarm_Pin_Event
+* Returns        : Nothing
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Notes that the pin went low, RTC_Alarm_Task clears the
+*                  alarm flag over I2C so the pin can signal the next match.
+*
+* Notes          : Call from the RTC pin interrupt on the falling edge.
+* Global Variables Affected : NA
+*****************************************************************************/
+void RTC_Alarm_Pin_Event(void)
+{
+	if (alm_hw_mode)
+	{
+		alm_pin_f = 1;
+	}
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Alarm_Task
+* Returns        : Nothing
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Releases the pin after a match, calls the callbacks of all
+*                  alarms due on the software clock (nearest first) and keeps
+*                  alarm 1 set to the nearest remaining one. A periodic alarm
+*                  is moved to its next time after now, firings missed while
+*                  the clock jumped forward are not made up.
+*
+* Notes          : Call from the main loop. Nothing fires before the software
+*                  clock holds a DS1339A reading.
+* Global Variables Affected : NA
+*****************************************************************************/
+void RTC_Alarm_Task(void)
+{
+	RTC_ALARM_CB cb;
+	U32 now, due;
+	U8 id;
+
+	if (alm_pin_f)
+	{
+		alm_pin_f = 0;
+		RTC_Clear_Alarm_Flags();
+	}
+
+	now = RTC_Clock_Get_Epoch();
+	if (now == 0)
+	{
+		return;
+	}
+
+	while ((alm_count > 0) && (alm_list[alm_order[0]].epoch <= now))
+	{
+		id = alm_order[0];
+		due = alm_list[id].epoch;
+		cb = alm_list[id].cb;
+
+		RTC_Alarm_Remove(id);
+		if (alm_list[id].period)
+		{
+			alm_list[id].epoch = due + (alm_list[id].period * (((now - due) / alm_list[id].period) + 1));
+			RTC_Alarm_Insert(id);
+		}
+		else
+		{
+			alm_list[id].cb = NULL;
+		}
+		cb(id, due);				// May add or cancel alarms.
+	}
+
+	if (alm_hw_mode)
+	{
+		RTC_Alarm_Program(now);
+	}
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Alarm_Insert
+* Returns        : Nothing
+* Arguments      : U8 id ---> Entry of alm_list with its time set.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Inserts the id into alm_order behind the alarms with the
+*                  same or an earlier time.
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+static void RTC_Alarm_Insert(U8 id)
+{
+	U8 pos = alm_count;
+
+	while ((pos > 0) && (alm_list[alm_order[pos - 1]].epoch > alm_list[id].epoch))
+	{
+		alm_order[pos] = alm_order[pos - 1];
+		pos --;
+	}
+	alm_order[pos] = id;
+	alm_count ++;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Alarm_Remove
+* Returns        : Nothing
+* Arguments      : U8 id ---> Active alarm.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Removes the id from alm_order, the order of the others is kept.
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+static void RTC_Alarm_Remove(U8 id)
+{
+	U8 pos;
+
+	for (pos = 0; pos < alm_count; pos ++)
+	{
+		if (alm_order[pos] == id)
+		{
+			break;
+		}
+	}
+	if (pos == alm_count)
+	{
+		return;
+	}
+	alm_count --;
+	for (; pos < alm_count; pos ++)
+	{
+		alm_order[pos] = alm_order[pos + 1];
+	}
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Alarm_Program
+* Returns        : Nothing
+* Arguments      : U32 now ---> Software clock, seconds since 1970-01-01.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Writes the nearest alarm into DS1339A alarm 1, or switches
+*                  alarm 1 off with an empty list, when it differs from what
+*                  was written last. A failed write is tried again one second
+*                  later, not on every call.
+*
+* Notes          : Waits for the bus.
+* Global Variables Affected : NA
+*****************************************************************************/
+static void RTC_Alarm_Program(U32 now)
+{
+	RTC_TIME time;
+	U32 next = RTC_Alarm_Next();
+	uint32_t status;
+
+	if ((next == alm_hw_epoch) || (now < alm_hw_retry))
+	{
+		return;
+	}
+
+	if (next)
+	{
+		RTC_Cal_From_Epoch(next, &time);
+		status = RTC_Set_Alarm1(&time);
+	}
+	else
+	{
+		status = RTC_Set_Alarm1(NULL);
+	}
+
+	if (status != TWI_SUCCESS)
+	{
+		alm_hw_retry = now + 1;
+		return;
+	}
+	alm_hw_epoch = next;
+	alm_hw_retry = 0;
+
+	#if RTC_ALARM_DEBUG
+	{
+		char text[RTC_CAL_ISO8601_LEN];
+
+		Print_Message("\nRTC alarm 1 : ");
+		if (next)
+		{
+			RTC_Cal_Format_ISO8601(&time, RTC_CAL_NO_MS, text);
+			Print_Message(text);
+		}
+		else
+		{
+			Print_Message("off");
+		}
+	}
+	#endif
+}
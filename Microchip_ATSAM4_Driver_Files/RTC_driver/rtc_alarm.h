@@ -0,0 +1,46 @@
+/*****************************************************************************
+*
+*
+* Module Name	: rtc_alarm.h
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Header file for rtc_alarm.c
+*				  Defines the software alarms multiplexed on DS1339A alarm 1.
+*
+*
+*****************************************************************************/
+#ifndef RTC_ALARM_H_
+#define RTC_ALARM_H_
+
+#include "asf.h"
+#include "user_rtc.h"
+
+/***** MACROS / DEFINITIONS *****/
+#ifndef RTC_ALARM_MAX
+#define RTC_ALARM_MAX				(8)			// Software alarms that can be scheduled at the same time.
+#endif
+
+#define RTC_ALARM_NONE				(0xFF)		// Alarm id not assigned.
+
+/***** Return Codes *****/
+#define RTC_ALARM_OK				0
+#define RTC_ALARM_ERR_FULL			1			// All RTC_ALARM_MAX alarms in use.
+#define RTC_ALARM_ERR_ARG			2			// No callback, time before 2000 or unknown id.
+#define RTC_ALARM_ERR_BUS			3			// DS1339A could not be written.
+
+/***** DEBUG MESSAGES *****/
+#define RTC_ALARM_DEBUG				(0)			// Print each programming of the DS1339A alarm.
+/***** END OF DEBUG MESSAGES *****/
+
+/***** Type Declarations *****/
+typedef void (*RTC_ALARM_CB)(U8 id, U32 epoch);	// Alarm id and the time it was scheduled for.
+
+/***** Function Prototypes *****/
+U8 RTC_Alarm_Init(void);
+U8 RTC_Alarm_Add(U32 epoch, U32 period, RTC_ALARM_CB cb, U8 *id);
+U8 RTC_Alarm_Cancel(U8 id);
+U32 RTC_Alarm_Next(void);
+void RTC_Alarm_Pin_Event(void);
+void RTC_Alarm_Task(void);
+
+#endif /* RTC_ALARM_H_ */
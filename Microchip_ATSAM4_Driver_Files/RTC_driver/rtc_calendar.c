@@ -0,0 +1,397 @@
+/*****************************************************************************
+*
+*
+* Module Name	: rtc_calendar.c
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Calendar for the RTC driver. Converts the DS1339A register
+*				  block to RTC_TIME and back, and RTC_TIME to seconds since
+*				  1970-01-01 (Unix epoch) and back, so times can be stored,
+*				  compared and subtracted as one U32.
+*
+*				  The conversions use tables instead of divisions where the
+*				  range is small : BCD digits, days before each month and the
+*				  month of a day of the year. Years are 2000 to 2106 (the
+*				  DS1339A starts at 2000, a U32 epoch ends in 2106), with
+*				  Gregorian leap years (2100 is not one).
+*
+*				  RTC_Cal_Format_ISO8601 writes a time as text in one pass,
+*				  the digits taken from the BCD table.
+*
+* Controller	: 	ATSAM4E16CA-AUR
+*					1024 KB		Flash.
+*					128 KB		RAM.
+*
+*****************************************************************************/
+#include "asf.h"
+#include "rtc_calendar.h"
+
+#define RTC_CAL_DAYS_1970_2000	(10957UL)	// Days from 1970-01-01 to 2000-01-01.
+#define RTC_CAL_DAYS_4_YEARS	(1461)		// 2000 to 2099 : four years with one leap year.
+#define RTC_CAL_DAY_2100_MAR_1	(36584UL)	// Days from 2000-01-01 to 2100-03-01.
+#define RTC_CAL_LAST_YEAR		(106)		// 2106, last year a U32 epoch reaches.
+#define RTC_CAL_LAST_SEC_2106	(3220095UL)	// Seconds into 2106 of 2106-02-07 06:28:15, the last U32 epoch.
+
+static U8 RTC_Cal_Put_2_Digits(char *buf, U8 value);
+
+/***** Local variables *****/
+static const U8 cal_bin_to_bcd[100] =
+{
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19,
+	0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29,
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+	0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+	0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99
+};
+
+static const U8 cal_bcd_tens[16] = {0, 10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110, 120, 130, 140, 150};
+
+// Days of the year before the first of each month, [1] for leap years. Entry 12 is the year length.
+static const U16 cal_days_before_month[2][13] =
+{
+	{0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365},
+	{0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366}
+};
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_Bin_To_BCD
+* Returns        : U8 ---> BCD value, 0x00 for values above 99.
+* Arguments      : U8 bin ---> 0 to 99.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : NA
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Cal_Bin_To_BCD(U8 bin)
+{
+	return (bin < 100) ? cal_bin_to_bcd[bin] : 0x00;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_BCD_To_Bin
+* Returns        : U8 ---> Decimal value.
+* Arguments      : U8 bcd ---> Two BCD digits, control bits masked off.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : NA
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Cal_BCD_To_Bin(U8 bcd)
+{
+	return cal_bcd_tens[bcd >> 4] + (bcd & 0x0F);
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_Is_Leap
+* Returns        : U8 ---> 1 for a leap year, else 0.
+* Arguments      : U16 year ---> Full year, e.g. 2024.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : NA
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Cal_Is_Leap(U16 year)
+{
+	if (year & 0x03)
+	{
+		return 0;
+	}
+	return ((year % 100) != 0) || ((year % 400) == 0);
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_Days_In_Month
+* Returns        : U8 ---> 28 to 31, 0 for an invalid month.
+* Arguments      : U16 year ---> Full year.
+*                  U8 month ---> 1 to 12.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : NA
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Cal_Days_In_Month(U16 year, U8 month)
+{
+	const U16 *table;
+
+	if ((month < 1) || (month > 12))
+	{
+		return 0;
+	}
+	table = cal_days_before_month[RTC_Cal_Is_Leap(year)];
+	return table[month] - table[month - 1];
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_Day_Of_Week
+* Returns        : U8 ---> 1 (Sunday) to 7, as the DS1339A day register.
+* Arguments      : U32 epoch ---> Seconds since 1970-01-01.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : 1970-01-01 was a Thursday.
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Cal_Day_Of_Week(U32 epoch)
+{
+	return (((epoch / RTC_CAL_SEC_PER_DAY) + 4) % 7) + 1;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_Is_Valid
+* Returns        : U8 ---> 1 if every field is in range, else 0.
+* Arguments      : const RTC_TIME *time
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Checks a time before it is written to the DS1339A or
+*                  converted, e.g. one received on the UART. The day of the
+*                  week is not checked, it is recomputed from the date. Times
+*                  after 2106-02-07 06:28:15 do not fit the U32 epoch and are
+*                  rejected.
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Cal_Is_Valid(const RTC_TIME *time)
+{
+	U16 years = time->year + (time->century ? 100 : 0);		// Since 2000.
+
+	if ((time->sec > 59) || (time->min > 59) || (time->hour > 23) || (time->year > 99) || (years > RTC_CAL_LAST_YEAR))
+	{
+		return 0;
+	}
+	if ((time->date < 1) || (time->date > RTC_Cal_Days_In_Month(2000 + years, time->month)))
+	{
+		return 0;
+	}
+	if ((years == RTC_CAL_LAST_YEAR) &&
+		((((cal_days_before_month[0][time->month - 1] + time->date - 1) * RTC_CAL_SEC_PER_DAY) + ((U32)time->hour * 3600) + ((U32)time->min * 60) + time->sec) > RTC_CAL_LAST_SEC_2106))
+	{
+		return 0;
+	}
+	return 1;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_To_Epoch
+* Returns        : U32 ---> Seconds since 1970-01-01 00:00:00.
+* Arguments      : const RTC_TIME *time ---> Valid time, 2000 to 2106-02-07.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Whole years counted with the leap days before the year,
+*                  the month from cal_days_before_month.
+*
+* Notes          : The day of the week is not used.
+* Global Variables Affected : NA
+*****************************************************************************/
+U32 RTC_Cal_To_Epoch(const RTC_TIME *time)
+{
+	U32 years = time->year + (time->century ? 100 : 0);		// Since 2000.
+	U32 leap_days = ((years + 3) / 4) - ((years + 99) / 100) + ((years + 399) / 400);	// Leap years 2000 to year - 1.
+	U32 days;
+
+	days = RTC_CAL_DAYS_1970_2000 + (years * 365) + leap_days
+		 + cal_days_before_month[RTC_Cal_Is_Leap(2000 + years)][time->month - 1] + time->date - 1;
+
+	return (days * RTC_CAL_SEC_PER_DAY) + ((U32)time->hour * 3600) + ((U32)time->min * 60) + time->sec;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_From_Epoch
+* Returns        : Nothing
+* Arguments      : U32 epoch ---> Seconds since 1970-01-01.
+*                  RTC_TIME *time ---> Filled including the day of the week.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Splits the days since 2000 in blocks of four years (the
+*                  first one of each a leap year). 2100-02-29 does not exist,
+*                  the days after it are moved up one so the blocks still fit.
+*                  yday / 32 is the month or the one before it, one compare
+*                  with cal_days_before_month finds it.
+*
+* Notes          : Epochs before 2000 give 2000-01-01 00:00:00.
+* Global Variables Affected : NA
+*****************************************************************************/
+void RTC_Cal_From_Epoch(U32 epoch, RTC_TIME *time)
+{
+	U32 days, secs, years;
+	U16 yday;
+	U8 leap, month;
+
+	if (epoch < RTC_CAL_EPOCH_2000)
+	{
+		epoch = RTC_CAL_EPOCH_2000;
+	}
+	days = epoch / RTC_CAL_SEC_PER_DAY;
+	secs = epoch - (days * RTC_CAL_SEC_PER_DAY);
+	time->day = ((days + 4) % 7) + 1;
+	time->hour = secs / 3600;
+	secs -= (U32)time->hour * 3600;
+	time->min = secs / 60;
+	time->sec = secs - ((U32)time->min * 60);
+
+	days -= RTC_CAL_DAYS_1970_2000;
+	if (days >= RTC_CAL_DAY_2100_MAR_1)
+	{
+		days ++;
+	}
+	years = (days / RTC_CAL_DAYS_4_YEARS) * 4;
+	yday = days % RTC_CAL_DAYS_4_YEARS;
+	if (yday >= 366)
+	{
+		yday -= 366;
+		years += 1 + (yday / 365);
+		yday %= 365;
+	}
+	leap = ((years & 0x03) == 0);			// Year of the four year blocks, 2100 included after the shift.
+
+	month = yday >> 5;
+	if (yday >= cal_days_before_month[leap][month + 1])
+	{
+		month ++;
+	}
+	time->month = month + 1;
+	time->date = yday - cal_days_before_month[leap][month] + 1;
+	time->year = years % 100;
+	time->century = (years >= 100) ? 1 : 0;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_From_Regs
+* Returns        : Nothing
+* Arguments      : const U8 *regs ---> Registers 0x00 to 0x06 as read from the DS1339A.
+*                  RTC_TIME *time ---> Filled with the decimal values.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Decodes the complete time register block in one pass. The
+*                  control bits are masked off before the BCD conversion : the
+*                  12/24 and AM/PM bits of the hour register (a 12 hour reading
+*                  is returned as 0 to 23) and the century bit of the month.
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+void RTC_Cal_From_Regs(const U8 *regs, RTC_TIME *time)
+{
+	U8 hour = regs[DS1339A_HOUR_REG];
+
+	time->sec = RTC_Cal_BCD_To_Bin(regs[DS1339A_SEC_REG] & 0x7F);
+	time->min = RTC_Cal_BCD_To_Bin(regs[DS1339A_MIN_REG] & 0x7F);
+	if (hour & DS1339A_HOUR_12H)
+	{
+		time->hour = RTC_Cal_BCD_To_Bin(hour & 0x1F) % 12;	// 12 AM is hour 0.
+		if (hour & DS1339A_HOUR_PM)
+		{
+			time->hour += 12;
+		}
+	}
+	else
+	{
+		time->hour = RTC_Cal_BCD_To_Bin(hour & 0x3F);
+	}
+	time->day = regs[DS1339A_DAY_REG] & 0x07;
+	time->date = RTC_Cal_BCD_To_Bin(regs[DS1339A_DATE_REG] & 0x3F);
+	time->month = RTC_Cal_BCD_To_Bin(regs[DS1339A_MONTH_REG] & 0x1F);
+	time->century = (regs[DS1339A_MONTH_REG] & DS1339A_CENTURY) ? 1 : 0;
+	time->year = RTC_Cal_BCD_To_Bin(regs[DS1339A_YEAR_REG]);
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_To_Regs
+* Returns        : Nothing
+* Arguments      : const RTC_TIME *time ---> Valid time.
+*                  U8 *regs ---> DS1339A_TIME_REGS bytes for registers 0x00 to 0x06.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Encodes a time for one write of the register block, hours
+*                  in 24 hour mode.
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+void RTC_Cal_To_Regs(const RTC_TIME *time, U8 *regs)
+{
+	regs[DS1339A_SEC_REG] = RTC_Cal_Bin_To_BCD(time->sec);
+	regs[DS1339A_MIN_REG] = RTC_Cal_Bin_To_BCD(time->min);
+	regs[DS1339A_HOUR_REG] = RTC_Cal_Bin_To_BCD(time->hour);
+	regs[DS1339A_DAY_REG] = time->day;
+	regs[DS1339A_DATE_REG] = RTC_Cal_Bin_To_BCD(time->date);
+	regs[DS1339A_MONTH_REG] = RTC_Cal_Bin_To_BCD(time->month) | (time->century ? DS1339A_CENTURY : 0);
+	regs[DS1339A_YEAR_REG] = RTC_Cal_Bin_To_BCD(time->year);
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_Format_ISO8601
+* Returns        : U8 ---> Characters written, without the NUL.
+* Arguments      : const RTC_TIME *time ---> Valid time.
+*                  U16 ms ---> 0 to 999, RTC_CAL_NO_MS to leave them out.
+*                  char *buf ---> RTC_CAL_ISO8601_LEN bytes.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Writes "YYYY-MM-DDTHH:MM:SS" or "YYYY-MM-DDTHH:MM:SS.mmm",
+*                  NUL terminated. No divisions except for the milliseconds.
+*
+* Notes          : Local time as the DS1339A holds it, no zone suffix.
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Cal_Format_ISO8601(const RTC_TIME *time, U16 ms, char *buf)
+{
+	char *p = buf;
+
+	*p++ = '2';
+	*p++ = time->century ? '1' : '0';
+	p += RTC_Cal_Put_2_Digits(p, time->year);
+	*p++ = '-';
+	p += RTC_Cal_Put_2_Digits(p, time->month);
+	*p++ = '-';
+	p += RTC_Cal_Put_2_Digits(p, time->date);
+	*p++ = 'T';
+	p += RTC_Cal_Put_2_Digits(p, time->hour);
+	*p++ = ':';
+	p += RTC_Cal_Put_2_Digits(p, time->min);
+	*p++ = ':';
+	p += RTC_Cal_Put_2_Digits(p, time->sec);
+	if (ms < 1000)
+	{
+		*p++ = '.';
+		*p++ = '0' + (ms / 100);
+		p += RTC_Cal_Put_2_Digits(p, ms % 100);
+	}
+	*p = '\0';
+
+	return p - buf;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Cal_Put_2_Digits
+* Returns        : U8 ---> 2, characters written.
+* Arguments      : char *buf
+*                  U8 value ---> 0 to 99.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Two decimal digits with a leading zero.
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+static U8 RTC_Cal_Put_2_Digits(char *buf, U8 value)
+{
+	U8 bcd = RTC_Cal_Bin_To_BCD(value);
+
+	buf[0] = '0' + (bcd >> 4);
+	buf[1] = '0' + (bcd & 0x0F);
+	return 2;
+}
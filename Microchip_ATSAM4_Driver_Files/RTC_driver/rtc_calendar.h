@@ -0,0 +1,38 @@
+/*****************************************************************************
+*
+*
+* Module Name	: rtc_calendar.h
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Header file for rtc_calendar.c
+*				  Conversions between the DS1339A register block, RTC_TIME
+*				  and seconds since 1970-01-01 (Unix epoch).
+*
+*
+*****************************************************************************/
+#ifndef RTC_CALENDAR_H_
+#define RTC_CALENDAR_H_
+
+#include "asf.h"
+#include "user_rtc.h"
+
+/***** MACROS / DEFINITIONS *****/
+#define RTC_CAL_EPOCH_2000		(946684800UL)	// 2000-01-01 00:00:00, first time the DS1339A holds.
+#define RTC_CAL_SEC_PER_DAY		(86400UL)
+#define RTC_CAL_ISO8601_LEN		(24)			// "YYYY-MM-DDTHH:MM:SS.mmm" and the NUL.
+#define RTC_CAL_NO_MS			(0xFFFF)		// RTC_Cal_Format_ISO8601 without milliseconds.
+
+/***** Function Prototypes *****/
+U8 RTC_Cal_Bin_To_BCD(U8 bin);
+U8 RTC_Cal_BCD_To_Bin(U8 bcd);
+U8 RTC_Cal_Is_Leap(U16 year);
+U8 RTC_Cal_Days_In_Month(U16 year, U8 month);
+U8 RTC_Cal_Day_Of_Week(U32 epoch);
+U8 RTC_Cal_Is_Valid(const RTC_TIME *time);
+U32 RTC_Cal_To_Epoch(const RTC_TIME *time);
+void RTC_Cal_From_Epoch(U32 epoch, RTC_TIME *time);
+void RTC_Cal_From_Regs(const U8 *regs, RTC_TIME *time);
+void RTC_Cal_To_Regs(const RTC_TIME *time, U8 *regs);
+U8 RTC_Cal_Format_ISO8601(const RTC_TIME *time, U16 ms, char *buf);
+
+#endif /* RTC_CALENDAR_H_ */
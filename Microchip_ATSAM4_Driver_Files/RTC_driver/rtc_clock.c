@@ -0,0 +1,472 @@
+/*****************************************************************************
+*
+*
+* Module Name	: rtc_clock.c
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Software clock for the application. The DS1339A is read once
+*				  at boot, after that the clock runs on the 1 ms TC0 tick and
+*				  RTC_Clock_Get returns the time from RAM without an I2C
+*				  transfer. The clock is kept as seconds since 1970-01-01,
+*				  RTC_TIME is made from it by rtc_calendar.c when asked for.
+*				  Every RTC_CLOCK_SYNC_INTERVAL seconds RTC_Clock_Task queues
+*				  one read of the DS1339A time registers, the reading replaces
+*				  the software time and the difference between both is kept as
+*				  the drift of the TC0 time base.
+*
+*				  The millisecond counter is phase locked to the DS1339A: each
+*				  falling edge of its 1 Hz output (RTC_Clock_Second_Edge) marks
+*				  the start of a second and the next tick moves the counter
+*				  there, holding it instead of stepping back so time stamps
+*				  never decrease. The correction is counted.
+*				  RTC_Clock_Get_Ms returns epoch seconds x 1000 + milliseconds.
+*				  The tick publishes the pair in one of two slots and then
+*				  switches the slot index, so it can be read from any interrupt
+*				  without masking.
+*
+* Controller	: 	ATSAM4E16CA-AUR
+*					1024 KB		Flash.
+*					128 KB		RAM.
+*
+*****************************************************************************/
+#include "asf.h"
+#include "rtc_clock.h"
+#include "rtc_calendar.h"
+#include "user_uart.h"
+#include "string.h"
+
+#define RTC_CLOCK_RETRY_SEC		(10)		// Delay before a failed sync is tried again.
+#define RTC_CLOCK_SYNC_MS_MIN	(100)		// Sync read only queued in the middle of a second,
+#define RTC_CLOCK_SYNC_MS_MAX	(900)		// so the DS1339A latches the second the read was queued in.
+
+/***** Global variables *****/
+volatile U8 gb_rtc_clock_sec_f = 0;
+
+/***** Local variables *****/
+static U32 clk_epoch = 0;						// Current second, seconds since 1970-01-01.
+static volatile U16 clk_ms = 0;					// Milliseconds into clk_epoch.
+static volatile U8 clk_edge_f = 0;				// A DS1339A second started since the last tick.
+static U16 clk_hold_ms = 0;						// Ticks to wait before counting again, TC0 ran ahead.
+static volatile U32 clk_stamp_sec[2];			// Published clk_epoch / clk_ms, written by the tick only.
+static volatile U16 clk_stamp_ms[2];
+static volatile U8 clk_stamp_idx = 0;			// Slot readers use.
+static volatile U32 clk_stamp_seq = 0;			// Incremented with each publish.
+static volatile U32 clk_unsynced_sec = 0;		// Seconds since the last DS1339A reading.
+static volatile U32 clk_sync_countdown = 0;		// Seconds till the next sync, 0 : due.
+static U8 clk_valid = 0;						// clk_epoch holds a DS1339A reading.
+static volatile U8 clk_sync_busy = 0;			// Sync read queued on the TWI bus.
+static U32 clk_sync_epoch = 0;					// clk_epoch when the sync read was queued.
+static volatile U8 clk_sync_report = 0;			// A sync ended, print it from the task.
+static U8 clk_sync_regs[DS1339A_TIME_REGS];
+static RTC_CLOCK_STATS clk_stats;
+
+static void RTC_Clock_Publish(void);
+static void RTC_Clock_Set(U32 epoch);
+static void RTC_Clock_Sync_Done(U8 *data, U32 len, uint32_t status);
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Init
+* Returns        : U8 ---> RTC_CLOCK_OK, else RTC_CLOCK_ERR_BUS (the task
+*                  retries the read). A reading out of range, e.g. the DS1339A
+*                  lost its backup supply, counts as a failed read.
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Reads the DS1339A and starts the software clock from it.
+*
+* Notes          : Call once at boot after RTC_Interrupt_Pin_Configure, before
+*                  the TC0 tick calls RTC_Clock_Tick_1ms.
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Clock_Init(void)
+{
+	RTC_TIME time;
+
+	memset(&clk_stats, 0, sizeof(clk_stats));
+	clk_valid = 0;
+	clk_sync_busy = 0;
+
+	if ((RTC_Read_Time(&time) != TWI_SUCCESS) || (!RTC_Cal_Is_Valid(&time)))
+	{
+		clk_stats.sync_errors ++;
+		clk_sync_countdown = 0;
+		return RTC_CLOCK_ERR_BUS;
+	}
+
+	NVIC_DisableIRQ(RTC_CLOCK_TICK_IRQn);
+	RTC_Clock_Set(RTC_Cal_To_Epoch(&time));
+	NVIC_EnableIRQ(RTC_CLOCK_TICK_IRQn);
+	return RTC_CLOCK_OK;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Tick_1ms
+* Returns        : Nothing
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Advances the software clock by one millisecond, and by one
+*                  second every 1000 calls. After a DS1339A edge the second
+*                  starts at this tick : a counter past 500 ms (TC0 slow) ends
+*                  the second now, a counter below (TC0 fast, second already
+*                  counted) stops until the DS1339A catches up.
+*
+* Notes          : Call in 1ms of timer ISR.
+* Global Variables Affected : gb_rtc_clock_sec_f
+*****************************************************************************/
+void RTC_Clock_Tick_1ms(void)
+{
+	if (clk_edge_f)
+	{
+		S32 err = (clk_ms >= 500) ? ((S32)clk_ms - 999) : ((S32)clk_ms + 1);	// Software clock ahead (+) or behind (-).
+
+		clk_edge_f = 0;
+		clk_stats.edges ++;
+		clk_stats.last_edge_err = err;
+		clk_stats.edge_corr_ms += err;
+		if (err > 0)
+		{
+			clk_hold_ms = (U16)err;
+		}
+		else
+		{
+			clk_hold_ms = 0;
+			clk_ms = 999;
+		}
+	}
+	if (clk_hold_ms)
+	{
+		clk_hold_ms --;
+		return;
+	}
+	if (++ clk_ms < 1000)
+	{
+		RTC_Clock_Publish();
+		return;
+	}
+	clk_ms = 0;
+
+	clk_epoch ++;
+	RTC_Clock_Publish();
+	clk_unsynced_sec ++;
+	if (clk_sync_countdown > 0)
+	{
+		clk_sync_countdown --;
+	}
+	gb_rtc_clock_sec_f = 1;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Second_Edge
+* Returns        : Nothing
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Latches the start of a DS1339A second for the next tick.
+*
+* Notes          : Call from the RTC pin interrupt on the falling edge.
+* Global Variables Affected : NA
+*****************************************************************************/
+void RTC_Clock_Second_Edge(void)
+{
+	clk_edge_f = 1;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Get_Ms
+* Returns        : U64 ---> Milliseconds since 1970-01-01 00:00:00, 0 while no
+*                  DS1339A reading has been taken yet.
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Time stamp for event records. Reads the slot published by
+*                  the last tick and reads again if a tick published in between.
+*
+* Notes          : No masking and no I2C, may be called from any interrupt.
+* Global Variables Affected : NA
+*****************************************************************************/
+U64 RTC_Clock_Get_Ms(void)
+{
+	U32 seq, sec;
+	U16 ms;
+	U8 idx;
+
+	do
+	{
+		seq = clk_stamp_seq;
+		idx = clk_stamp_idx;
+		sec = clk_stamp_sec[idx];
+		ms = clk_stamp_ms[idx];
+	} while (seq != clk_stamp_seq);
+
+	return clk_valid ? (((U64)sec * 1000) + ms) : 0;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Get_Epoch
+* Returns        : U32 ---> Seconds since 1970-01-01 00:00:00, 0 while no
+*                  DS1339A reading has been taken yet.
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Current second of the software clock, for comparing and
+*                  subtracting times.
+*
+* Notes          : No masking and no I2C, may be called from any interrupt.
+* Global Variables Affected : NA
+*****************************************************************************/
+U32 RTC_Clock_Get_Epoch(void)
+{
+	U32 seq, sec;
+
+	do
+	{
+		seq = clk_stamp_seq;
+		sec = clk_stamp_sec[clk_stamp_idx];
+	} while (seq != clk_stamp_seq);
+
+	return clk_valid ? sec : 0;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Get
+* Returns        : U8 ---> RTC_CLOCK_OK, RTC_CLOCK_ERR_NOT_SET while no DS1339A
+*                  reading has been taken yet.
+* Arguments      : RTC_TIME *time ---> Filled with the current time and date.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Converts the software clock, no I2C transfer.
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Clock_Get(RTC_TIME *time)
+{
+	if (!clk_valid)
+	{
+		return RTC_CLOCK_ERR_NOT_SET;
+	}
+	RTC_Cal_From_Epoch(RTC_Clock_Get_Epoch(), time);
+	return RTC_CLOCK_OK;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Task
+* Returns        : Nothing
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Queues the read of the DS1339A once a sync is due and prints
+*                  the result of the last one. Does not wait for the bus. The
+*                  read is only queued between RTC_CLOCK_SYNC_MS_MIN and
+*                  RTC_CLOCK_SYNC_MS_MAX into a second, away from the rollover
+*                  of the DS1339A, and the second it is queued in is kept.
+*
+* Notes          : Call from the main loop.
+* Global Variables Affected : NA
+*****************************************************************************/
+void RTC_Clock_Task(void)
+{
+	if (clk_sync_report)
+	{
+		clk_sync_report = 0;
+		#if RTC_CLOCK_DEBUG
+		RTC_Clock_Print_Stats();
+		#endif
+	}
+
+	if ((clk_sync_busy) || (clk_sync_countdown > 0))
+	{
+		return;
+	}
+	if ((clk_ms < RTC_CLOCK_SYNC_MS_MIN) || (clk_ms > RTC_CLOCK_SYNC_MS_MAX))
+	{
+		return;
+	}
+
+	clk_sync_epoch = clk_epoch;
+	clk_sync_busy = 1;
+	if (RTC_Read_Time_Async(clk_sync_regs, RTC_Clock_Sync_Done) != TWI_BUS_OK)
+	{
+		clk_sync_busy = 0;			// Queue full, tried again on the next call.
+	}
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Request_Sync
+* Returns        : Nothing
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Makes the next RTC_Clock_Task read the DS1339A, e.g. after
+*                  the DS1339A time was written.
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+void RTC_Clock_Request_Sync(void)
+{
+	clk_sync_countdown = 0;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Get_Stats
+* Returns        : Nothing
+* Arguments      : RTC_CLOCK_STATS *stats ---> Filled with a copy of the counters.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : NA
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+void RTC_Clock_Get_Stats(RTC_CLOCK_STATS *stats)
+{
+	NVIC_DisableIRQ(TWI0_IRQn);				// Updated by the sync callback.
+	*stats = clk_stats;
+	NVIC_EnableIRQ(TWI0_IRQn);
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Print_Stats
+* Returns        : Nothing
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Prints the sync counters and the drift on the debug UART.
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+void RTC_Clock_Print_Stats(void)
+{
+	RTC_CLOCK_STATS stats;
+
+	RTC_Clock_Get_Stats(&stats);
+
+	Print_Message("\nRTC clock sync : ");
+	Print_Number(stats.syncs);
+	Print_Message(" err : ");
+	Print_Number(stats.sync_errors);
+	Print_Message(" drift s : ");
+	if (stats.last_drift < 0)
+	{
+		Print_Message("-");
+	}
+	Print_Number((stats.last_drift < 0) ? -stats.last_drift : stats.last_drift);
+	Print_Message(" in s : ");
+	Print_Number(stats.last_interval);
+	Print_Message(" max s : ");
+	Print_Number((stats.max_drift < 0) ? -stats.max_drift : stats.max_drift);
+	Print_Message(" edges : ");
+	Print_Number(stats.edges);
+	Print_Message(" corr ms : ");
+	if (stats.edge_corr_ms < 0)
+	{
+		Print_Message("-");
+	}
+	Print_Number((stats.edge_corr_ms < 0) ? -stats.edge_corr_ms : stats.edge_corr_ms);
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Publish
+* Returns        : Nothing
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Writes clk_epoch / clk_ms into the slot readers are not
+*                  using, then makes it the current one.
+*
+* Notes          : Tick interrupt or tick interrupt masked.
+* Global Variables Affected : NA
+*****************************************************************************/
+static void RTC_Clock_Publish(void)
+{
+	U8 idx = clk_stamp_idx ^ 1;
+
+	clk_stamp_sec[idx] = clk_epoch;
+	clk_stamp_ms[idx] = clk_ms;
+	clk_stamp_idx = idx;
+	clk_stamp_seq ++;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Set
+* Returns        : Nothing
+* Arguments      : U32 epoch ---> DS1339A reading, seconds since 1970-01-01.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Loads the software clock and restarts the sync interval.
+*
+* Notes          : Call with the tick interrupt masked. The millisecond phase
+*                  is kept, the DS1339A reading has a resolution of one second.
+* Global Variables Affected : NA
+*****************************************************************************/
+static void RTC_Clock_Set(U32 epoch)
+{
+	clk_epoch = epoch;
+	RTC_Clock_Publish();
+	clk_unsynced_sec = 0;
+	clk_sync_countdown = RTC_CLOCK_SYNC_INTERVAL;
+	clk_valid = 1;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clock_Sync_Done
+* Returns        : Nothing
+* Arguments      : TWI_BUS_CB arguments of the time register read.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Runs in TWI0_Handler. The reading belongs to the second the
+*                  read was queued in, seconds the software clock entered since
+*                  then are added to it. Takes the difference between the
+*                  DS1339A and the software clock as the drift and loads the
+*                  corrected reading. A failed read is tried again after
+*                  RTC_CLOCK_RETRY_SEC.
+*
+* Notes          : NA
+* Global Variables Affected : NA
+*****************************************************************************/
+static void RTC_Clock_Sync_Done(U8 *data, U32 len, uint32_t status)
+{
+	RTC_TIME rtc;
+	U32 epoch;
+	S32 drift;
+
+	if (status == TWI_SUCCESS)
+	{
+		RTC_Cal_From_Regs(data, &rtc);
+		if (!RTC_Cal_Is_Valid(&rtc))
+		{
+			status = TWI_INVALID_ARGUMENT;		// Registers out of range, DS1339A time lost.
+		}
+	}
+	if (status != TWI_SUCCESS)
+	{
+		clk_stats.sync_errors ++;
+		clk_sync_countdown = RTC_CLOCK_RETRY_SEC;
+		clk_sync_busy = 0;
+		return;
+	}
+	epoch = RTC_Cal_To_Epoch(&rtc);
+
+	NVIC_DisableIRQ(RTC_CLOCK_TICK_IRQn);
+	epoch += clk_epoch - clk_sync_epoch;		// Rollover between the latch and this callback.
+	drift = (S32)(epoch - clk_epoch);
+
+	clk_stats.syncs ++;
+	if (clk_valid)
+	{
+		clk_stats.last_drift = drift;
+		clk_stats.last_interval = clk_unsynced_sec;
+		if (((drift < 0) ? -drift : drift) > ((clk_stats.max_drift < 0) ? -clk_stats.max_drift : clk_stats.max_drift))
+		{
+			clk_stats.max_drift = drift;
+		}
+	}
+	RTC_Clock_Set(epoch);
+	NVIC_EnableIRQ(RTC_CLOCK_TICK_IRQn);
+
+	clk_sync_busy = 0;
+	clk_sync_report = 1;
+}
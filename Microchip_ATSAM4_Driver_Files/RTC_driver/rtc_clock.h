@@ -0,0 +1,64 @@
+/*****************************************************************************
+*
+*
+* Module Name	: rtc_clock.h
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Header file for rtc_clock.c
+*				  Defines the software clock kept in step with the DS1339A.
+*
+*
+*****************************************************************************/
+#ifndef RTC_CLOCK_H_
+#define RTC_CLOCK_H_
+
+#include "asf.h"
+#include "user_rtc.h"
+
+/***** MACROS / DEFINITIONS *****/
+#ifndef RTC_CLOCK_SYNC_INTERVAL
+#define RTC_CLOCK_SYNC_INTERVAL		(3600)		// Seconds between two reads of the DS1339A.
+#endif
+
+#ifndef RTC_CLOCK_TICK_IRQn
+#define RTC_CLOCK_TICK_IRQn			(TC0_IRQn)	// Interrupt calling RTC_Clock_Tick_1ms, masked while the clock is copied.
+#endif
+
+/***** Return Codes *****/
+#define RTC_CLOCK_OK				0
+#define RTC_CLOCK_ERR_BUS			1			// DS1339A could not be read.
+#define RTC_CLOCK_ERR_NOT_SET		2			// No DS1339A reading taken yet.
+
+/***** DEBUG MESSAGES *****/
+#define RTC_CLOCK_DEBUG				(0)			// Report the drift of every sync on the debug UART.
+/***** END OF DEBUG MESSAGES *****/
+
+/***** Structure Declarations *****/
+typedef struct
+{
+	U32 syncs;						// DS1339A readings applied to the clock.
+	U32 sync_errors;				// Readings that failed or could not be queued.
+	S32 last_drift;					// DS1339A minus software clock at the last sync, in seconds.
+	S32 max_drift;					// Largest last_drift seen (by magnitude).
+	U32 last_interval;				// Seconds the clock ran on its own before the last sync.
+	U32 edges;						// DS1339A 1 Hz edges the millisecond counter was aligned to.
+	S32 last_edge_err;				// Millisecond counter error at the last edge, + : TC0 fast.
+	S32 edge_corr_ms;				// Sum of the edge errors, TC0 drift against the DS1339A crystal.
+}RTC_CLOCK_STATS;
+
+/***** Extern variables *****/
+extern volatile U8 gb_rtc_clock_sec_f;	// Set each time the software clock enters a new second.
+
+/***** Function Prototypes *****/
+U8 RTC_Clock_Init(void);
+void RTC_Clock_Tick_1ms(void);
+void RTC_Clock_Second_Edge(void);
+U64 RTC_Clock_Get_Ms(void);
+U32 RTC_Clock_Get_Epoch(void);
+U8 RTC_Clock_Get(RTC_TIME *time);
+void RTC_Clock_Task(void);
+void RTC_Clock_Request_Sync(void);
+void RTC_Clock_Get_Stats(RTC_CLOCK_STATS *stats);
+void RTC_Clock_Print_Stats(void);
+
+#endif /* RTC_CLOCK_H_ */
@@ -16,71 +16,68 @@
 #include "user_rtc.h"
 //#include "definitions.h"
 #include "user_uart.h"
+#include "user_i2c.h"
+#include "rtc_clock.h"
+#include "rtc_calendar.h"
+#include "rtc_alarm.h"
 #include "string.h"
 
 /***** Definitions *****/
 #define DS1339A_SLAVE_ADDRESS (0x68)
+#define DS1339A_TWI_SPEED	(400000)	// DS1339A supports 400 kHz fast mode.
 
-#define DS1339A_SEC_REG		(0x00)
-#define DS1339A_MIN_REG		(0x01)
-#define DS1339A_HOUR_REG	(0x02)
-#define DS1339A_DAY_REG		(0x03)
-#define DS1339A_DATE_REG	(0x04)
-#define DS1339A_MONTH_REG	(0x05)
-#define DS1339A_YEAR_REG	(0x06)
+#define DS1339A_ALARM1_REG	(0x07)		// Alarm 1 seconds, minutes, hours, day / date.
 #define DS1339A_CONTROL_REG	(0x0E)
 #define DS1339A_STATUS_REG	(0x0F)
+
+#define DS1339A_CTRL_SQW_1HZ	(0x00)	// Control register : INTCN = 0, RS = 1 Hz square wave on SQW/INT.
+#define DS1339A_CTRL_INTCN		(0x04)	// Control register : INTCN = 1, alarm interrupts only, pin idle high.
+#define DS1339A_CTRL_A1IE		(0x01)	// Control register : alarm 1 drives the pin low on a match.
+#define DS1339A_ALARM_MASK		(0x80)	// Alarm register : field ignored in the match.
+#define DS1339A_STS_ALARM_FLAGS	(0x03)	// Status register : A2F, A1F.
 #define BUFFER_SIZE 64
 
-U8 gb_read_stsReg_at_pwrOn_f = 1;
 volatile U8 gb_rtc_1secInt_triggered_f = 0;
 
 U8 gb_rtc_send_to_server_f = 1;
 U8 gb_rtcTimeArr[3] = {0};
 U8 gb_rtcDateArr[4] = {0};
+U32 gb_rtcEpoch = 0;
 U8 rtcUpdateArr[6] = {0};
 U8 gb_rtc_time_update_f = 0;
 
-/*****************************************************************************
-* Function Name  : DecimalToBCD
-* Returns        : int - The BCD (Binary-Coded Decimal) equivalent of the input decimal value.
-* Arguments      : int Decimal ---> The decimal number to be converted to BCD format.
-* Created by     : Anup Silvan Mascarenhas
-*
-* Description    : Converts a decimal number into its BCD (Binary-Coded Decimal) equivalent.
-*                  In BCD, each digit of the decimal number is represented by its own binary
-*                  sequence, making it easy to encode and decode individual digits.
-*
-* Notes          : This function assumes the input decimal number is less than 100.
-* Global Variables Affected : NA
-*****************************************************************************/
-static int DecimalToBCD(int Decimal)
+static void RTC_Update_Time_Arrays(const RTC_TIME *time);
+
+static const char *const rtc_weekday_name[8] =
 {
-	// Divide the decimal number by 10 to get the tens digit, shift it left by 4 bits,
-	// and combine it with the ones digit (Decimal % 10) using a bitwise OR.
-	return (((Decimal / 10) << 4) | (Decimal % 10));
-}
+	"---", "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"
+};
 
 /*****************************************************************************
-* Function Name  : BCDToDecimal
-* Returns        : int - The decimal equivalent of the input BCD (Binary-Coded Decimal) value.
-* Arguments      : int BCD ---> The BCD value to be converted to decimal format.
+* Function Name  : RTC_Update_Time_Arrays
+* Returns        : Nothing
+* Arguments      : const RTC_TIME *time ---> Decoded reading.
 * Created by     : Anup Silvan Mascarenhas
 *
-* Description    : Converts a BCD (Binary-Coded Decimal) value into its decimal equivalent.
-*                  In BCD format, each digit of a decimal number is represented by a 4-bit binary
-*                  value. This function decodes the BCD format into a regular decimal integer.
+* Description    : Copies a reading into gb_rtcTimeArr (hour, minutes, seconds)
+*                  and gb_rtcDateArr (date, month, year, day), and as seconds
+*                  since 1970-01-01 into gb_rtcEpoch.
 *
-* Notes          : The input BCD value should represent a valid decimal number encoded in BCD.
-* Global Variables Affected : NA
+* Notes          : NA
+* Global Variables Affected : gb_rtcTimeArr, gb_rtcDateArr, gb_rtcEpoch
 *****************************************************************************/
-static int BCDToDecimal(int BCD)
+static void RTC_Update_Time_Arrays(const RTC_TIME *time)
 {
-	// Shift the BCD value right by 4 bits to extract the tens digit (upper nibble),
-	// then multiply by 10 to get its decimal equivalent.
-	// Use bitwise AND with 0xF to extract the ones digit (lower nibble),
-	// and add it to the tens digit to form the final decimal number.
-	return (((BCD >> 4) * 10) + (BCD & 0xF));
+	gb_rtcEpoch = RTC_Cal_Is_Valid(time) ? RTC_Cal_To_Epoch(time) : 0;
+	
+	gb_rtcTimeArr[0] = time->hour;
+	gb_rtcTimeArr[1] = time->min;
+	gb_rtcTimeArr[2] = time->sec;
+	
+	gb_rtcDateArr[0] = time->date;
+	gb_rtcDateArr[1] = time->month;
+	gb_rtcDateArr[2] = time->year;
+	gb_rtcDateArr[3] = time->day;
 }
 
 /*****************************************************************************
@@ -99,7 +96,7 @@ static int BCDToDecimal(int BCD)
 static void Update_I2C_Packet_To_Send(U8 RegAdd, U8 byteValue)
 {
 	// Convert the given decimal value to BCD format before sending over I2C.
-	uint8_t bcd_seconds = DecimalToBCD(byteValue);
+	uint8_t bcd_seconds = RTC_Cal_Bin_To_BCD(byteValue);
 	
 	// Declare a structure to hold the TWI (I2C) packet information.
 	twi_package_t packet_write;
@@ -112,7 +109,7 @@ static void Update_I2C_Packet_To_Send(U8 RegAdd, U8 byteValue)
 	packet_write.chip = DS1339A_SLAVE_ADDRESS;  // Set the I2C address of the DS1339A RTC device.
 	
 	// Attempt to send the data packet over I2C using the TWI interface.
-	if (twi_master_write(TWI0, &packet_write) != TWI_SUCCESS)
+	if (twi_bus_write(&packet_write) != TWI_SUCCESS)
 	{
 		// If the write operation fails, print an error message.
 		#if (DEBUG_ALL || DEBUG_RTC)
@@ -155,7 +152,7 @@ static U8 Update_I2C_Packet_To_Read(U8 RegAdd)
 	packet_read.chip = DS1339A_SLAVE_ADDRESS;     // Slave address of the DS1339A RTC
 	
 	// Perform the TWI read operation
-	if (twi_master_read(TWI0, &packet_read) != TWI_SUCCESS)
+	if (twi_bus_read(&packet_read) != TWI_SUCCESS)
 	{
 		// If the read operation fails, print an error message and return 0
 		#if (DEBUG_ALL || DEBUG_RTC)
@@ -165,7 +162,7 @@ static U8 Update_I2C_Packet_To_Read(U8 RegAdd)
 	}
 	
 	// Convert the read value from BCD to decimal and return it
-	return BCDToDecimal(read_val);
+	return RTC_Cal_BCD_To_Bin(read_val);
 }
 
 /*****************************************************************************
@@ -192,7 +189,7 @@ static U8 Read_Status_Register(void)
 	packet_rx.length = 1;                   // Number of bytes to read (1 byte)
 
 	// Perform the TWI read operation to get the status register
-	if (twi_master_read(TWI0, &packet_rx) != TWI_SUCCESS)
+	if (twi_bus_read(&packet_rx) != TWI_SUCCESS)
 	{
 		#if (DEBUG_ALL || DEBUG_RTC)
 		Print_Message("\nFailed to read Status Register."); // Print error message if read operation fails
@@ -226,7 +223,7 @@ static void Write_To_Status_Register(U8 byteValue)
 	packet_tx.length = 1;                  // Number of bytes to write (1 byte)
 
 	// Perform the TWI write operation to update the status register
-	if (twi_master_write(TWI0, &packet_tx) != TWI_SUCCESS)
+	if (twi_bus_write(&packet_tx) != TWI_SUCCESS)
 	{
 		#if (DEBUG_ALL || DEBUG_RTC)
 		Print_Message("\nFailed to write data into Status Register."); // Print error message if write operation fails
@@ -262,46 +259,54 @@ static void RTC_Interrupt_Handler(const uint32_t id, const uint32_t index)
 		{
 			// Set the global flag to indicate that an RTC interrupt has occurred
 			gb_rtc_1secInt_triggered_f = 1;
+			RTC_Clock_Second_Edge();	// A DS1339A second starts, latched for the millisecond counter.
+			RTC_Alarm_Pin_Event();		// In alarm mode the edge is an alarm 1 match.
 		}
 	}
 }
 
 /*****************************************************************************
 * Function Name  : Configure_Interrupt_Logic_For_RTC
-* Returns        : Nothing
-* Arguments      : U8 byteVal ---> Pass value to control register.
+* Returns        : uint32_t ---> TWI_SUCCESS or the first TWI error.
+* Arguments      : U8 *alarmVal ---> Values of the alarm 1 registers 0x07 to 0x0A.
+*				   U8 byteVal ---> Pass value to control register.
 * Created by     : Anup Silvan Mascarenhas
 *
-* Description    : Configures interrupt output on the pin instead of square wave output.
-*				   Enables alarm 1 output and an alarm is set for every one sec.
+* Description    : Writes the alarm 1 registers and the control register,
+*				   which selects between the alarm interrupt and the square
+*				   wave on the SQW/INT pin.
 *
 * Notes          : NA.
 * Global Variables Affected : NA.
 *****************************************************************************/
-static void Configure_Interrupt_Logic_For_RTC(U8 byteVal)
+static uint32_t Configure_Interrupt_Logic_For_RTC(U8 *alarmVal, U8 byteVal)
 {
-	// Prepare the packet to write the specified value to the control and Alarm register of the DS1339A RTC
-	twi_package_t packet_tx;
+	// Alarm registers and control register are written in one TWI batch
+	TWI_BUS_OP ops[2];
 	
-	U8 oneSecAlmValue[4] = {0};
-	oneSecAlmValue[0] = 0x80;	// Set mask bit for the register 0x07
-	oneSecAlmValue[1] = 0x80;	// Set mask bit for the register 0x08
-	oneSecAlmValue[2] = 0x80;	// Set mask bit for the register 0x09
-	oneSecAlmValue[3] = 0x80;	// Set mask bit for the register 0x0A
+	ops[0].packet.addr[0] = DS1339A_ALARM1_REG;	// Start Address of the alarm register
+	ops[0].packet.addr_length = 1;              // Length of the address (1 byte)
+	ops[0].packet.buffer = alarmVal;			// Buffer containing the value to write to the alarm register
+	ops[0].packet.chip = DS1339A_SLAVE_ADDRESS; // I2C slave address of the DS1339A RTC
+	ops[0].packet.length = 4;					// Number of bytes to write (4 byte)
+	ops[0].dir = TWI_BUS_DIR_WRITE;
 	
-	packet_tx.addr[0] = 0x07;				// Start Address of the alarm register
-	packet_tx.addr_length = 1;              // Length of the address (1 byte)
-	packet_tx.buffer = oneSecAlmValue;		// Buffer containing the value to write to the alarm register
-	packet_tx.chip = DS1339A_SLAVE_ADDRESS; // I2C slave address of the DS1339A RTC
-	packet_tx.length = 4;					// Number of bytes to write (4 byte)
+	ops[1].packet.addr[0] = DS1339A_CONTROL_REG; // Address of the control register
+	ops[1].packet.addr_length = 1;              // Length of the address (1 byte)
+	ops[1].packet.buffer = &byteVal;			// Buffer containing the value to write to the control register
+	ops[1].packet.chip = DS1339A_SLAVE_ADDRESS; // I2C slave address of the DS1339A RTC
+	ops[1].packet.length = 1;					// Number of bytes to write (1 byte)
+	ops[1].dir = TWI_BUS_DIR_WRITE;
 	
-	if (twi_master_write(TWI0, &packet_tx) != TWI_SUCCESS)
+	twi_bus_batch(ops, 2);
+	
+	if (ops[0].status != TWI_SUCCESS)
 	{
 		#if (DEBUG_ALL || DEBUG_RTC)
 		Print_Message("\nFailed to write data into alarm Register."); // Print error message if write operation fails
 		#endif
 		
-		return; // Exit the function if writing fails
+		return ops[0].status; // Exit the function if writing fails
 	}
 	else
 	{
@@ -310,20 +315,14 @@ static void Configure_Interrupt_Logic_For_RTC(U8 byteVal)
 		#endif		
 	}
 	
-	packet_tx.addr[0] = DS1339A_CONTROL_REG; // Address of the control register
-	packet_tx.addr_length = 1;              // Length of the address (1 byte)
-	packet_tx.buffer = &byteVal;			// Buffer containing the value to write to the control register
-	packet_tx.chip = DS1339A_SLAVE_ADDRESS; // I2C slave address of the DS1339A RTC
-	packet_tx.length = 1;					// Number of bytes to write (1 byte)
-	
-	// Perform the TWI write operation to update the control register
-	if (twi_master_write(TWI0, &packet_tx) != TWI_SUCCESS)
+	// Check the control register write
+	if (ops[1].status != TWI_SUCCESS)
 	{
 		#if (DEBUG_ALL || DEBUG_RTC)
 		Print_Message("\nFailed to write data into Control Register."); // Print error message if write operation fails
 		#endif
 		
-		return; // Exit the function if writing fails
+		return ops[1].status; // Exit the function if writing fails
 	}
 	else
 	{
@@ -331,6 +330,7 @@ static void Configure_Interrupt_Logic_For_RTC(U8 byteVal)
 		Print_Message("\nWrite success to Control Register.");
 		#endif
 	}
+	return TWI_SUCCESS;
 }
 
 /*****************************************************************************
@@ -343,6 +343,9 @@ static void Configure_Interrupt_Logic_For_RTC(U8 byteVal)
 *                  This function enables the necessary peripheral clocks, configures the pin
 *                  as an input with a pull-up resistor, sets the interrupt handler, and enables
 *                  the interrupt for a falling edge signal.
+*                  The DS1339A drives a 1 Hz square wave on the pin, so the
+*                  interrupt comes every second without clearing an alarm flag
+*                  over I2C.
 *
 * Notes          : This setup is specific to handling interrupts from the RTC connected to pin PD28.
 * Global Variables Affected : NA
@@ -360,7 +363,73 @@ void RTC_Interrupt_Pin_Configure(void)
 	// Enable the PIOD interrupt in the Nested Vectored Interrupt Controller (NVIC)
 	NVIC_EnableIRQ(PIOD_IRQn);
 	
-	Configure_Interrupt_Logic_For_RTC(0x05);	// Set an alarm for an every one second.
+	twi_bus_register_device(DS1339A_SLAVE_ADDRESS, DS1339A_TWI_SPEED);
+	
+	U8 oneSecAlmValue[4] = {DS1339A_ALARM_MASK, DS1339A_ALARM_MASK, DS1339A_ALARM_MASK, DS1339A_ALARM_MASK};
+	Configure_Interrupt_Logic_For_RTC(oneSecAlmValue, DS1339A_CTRL_SQW_1HZ);	// 1 Hz square wave instead of the alarm every second.
+	
+	// An alarm flag left set by the earlier alarm configuration is cleared
+	RTC_Clear_Alarm_Flags();
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Set_Alarm1
+* Returns        : uint32_t ---> TWI_SUCCESS, TWI_INVALID_ARGUMENT for a time
+*                  out of range, else the TWI error of the write.
+* Arguments      : const RTC_TIME *time ---> Alarm time, NULL to switch the
+*                  alarm off.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Programs alarm 1 to match seconds, minutes, hours and date
+*                  and switches the pin from the 1 Hz square wave to the alarm
+*                  interrupt (INTCN = 1). The pin then goes low only on the
+*                  match and stays low till RTC_Clear_Alarm_Flags. With NULL
+*                  the pin stays high.
+*
+* Notes          : The date repeats every month, an alarm further away than
+*                  the current month can match early. Waits for the bus.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint32_t RTC_Set_Alarm1(const RTC_TIME *time)
+{
+	U8 alarmVal[4] = {DS1339A_ALARM_MASK, DS1339A_ALARM_MASK, DS1339A_ALARM_MASK, DS1339A_ALARM_MASK};
+	
+	if (time == NULL)
+	{
+		return Configure_Interrupt_Logic_For_RTC(alarmVal, DS1339A_CTRL_INTCN);
+	}
+	if (!RTC_Cal_Is_Valid(time))
+	{
+		return TWI_INVALID_ARGUMENT;
+	}
+	
+	alarmVal[0] = RTC_Cal_Bin_To_BCD(time->sec);	// Mask bits 0 : every field is compared
+	alarmVal[1] = RTC_Cal_Bin_To_BCD(time->min);
+	alarmVal[2] = RTC_Cal_Bin_To_BCD(time->hour);	// 24 hour mode
+	alarmVal[3] = RTC_Cal_Bin_To_BCD(time->date);	// DY/DT = 0 : date of the month
+	return Configure_Interrupt_Logic_For_RTC(alarmVal, DS1339A_CTRL_INTCN | DS1339A_CTRL_A1IE);
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Clear_Alarm_Flags
+* Returns        : Nothing
+* Arguments      : None
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Clears A1F and A2F in the status register, which releases
+*                  the pin in alarm mode. The other status bits are written back.
+*
+* Notes          : Waits for the bus.
+* Global Variables Affected : NA
+*****************************************************************************/
+void RTC_Clear_Alarm_Flags(void)
+{
+	U8 status_reg = Read_Status_Register();
+	
+	if (status_reg & DS1339A_STS_ALARM_FLAGS)
+	{
+		Write_To_Status_Register(status_reg & ~DS1339A_STS_ALARM_FLAGS);
+	}
 }
 
 /*****************************************************************************
@@ -666,6 +735,105 @@ U8 Read_Year_From_DS1339A(void)
 	return Update_I2C_Packet_To_Read(DS1339A_YEAR_REG);
 }
 
+/*****************************************************************************
+* Function Name  : RTC_Read_Time
+* Returns        : uint32_t ---> TWI_SUCCESS or the TWI error of the read.
+* Arguments      : RTC_TIME *time ---> Filled with the current time and date.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Reads the registers 0x00 to 0x06 in one I2C transfer and
+*                  decodes them, instead of one transfer per Read_xxx_From_DS1339A.
+*                  The DS1339A latches all time registers at the START, so the
+*                  fields belong to the same second.
+*
+* Notes          : Waits for the bus. time is left unchanged on an error.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint32_t RTC_Read_Time(RTC_TIME *time)
+{
+	U8 regs[DS1339A_TIME_REGS];
+	uint32_t status;
+	
+	twi_package_t packet_read;
+	packet_read.addr[0] = DS1339A_SEC_REG;         // First register of the block
+	packet_read.addr_length = 1;
+	packet_read.buffer = regs;
+	packet_read.length = DS1339A_TIME_REGS;        // Seconds to year
+	packet_read.chip = DS1339A_SLAVE_ADDRESS;
+	
+	status = twi_bus_read(&packet_read);
+	if (status != TWI_SUCCESS)
+	{
+		#if (DEBUG_ALL || DEBUG_RTC)
+		Print_Message("\nTWI is read unsuccessfully.");
+		#endif
+		return status;
+	}
+	
+	RTC_Cal_From_Regs(regs, time);
+	return TWI_SUCCESS;
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Write_Time
+* Returns        : uint32_t ---> TWI_SUCCESS, TWI_INVALID_ARGUMENT for a time
+*                  out of range, else the TWI error of the write.
+* Arguments      : const RTC_TIME *time ---> New time and date, 24 hour.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Writes the registers 0x00 to 0x06 in one I2C transfer. The
+*                  day of the week is computed from the date.
+*
+* Notes          : Waits for the bus. Call RTC_Clock_Request_Sync after it.
+* Global Variables Affected : NA
+*****************************************************************************/
+uint32_t RTC_Write_Time(const RTC_TIME *time)
+{
+	U8 regs[DS1339A_TIME_REGS];
+	RTC_TIME set = *time;
+	
+	if (!RTC_Cal_Is_Valid(&set))
+	{
+		return TWI_INVALID_ARGUMENT;
+	}
+	set.day = RTC_Cal_Day_Of_Week(RTC_Cal_To_Epoch(&set));
+	RTC_Cal_To_Regs(&set, regs);
+	
+	twi_package_t packet_write;
+	packet_write.addr[0] = DS1339A_SEC_REG;        // First register of the block
+	packet_write.addr_length = 1;
+	packet_write.buffer = regs;
+	packet_write.length = DS1339A_TIME_REGS;       // Seconds to year
+	packet_write.chip = DS1339A_SLAVE_ADDRESS;
+	
+	return twi_bus_write(&packet_write);
+}
+
+/*****************************************************************************
+* Function Name  : RTC_Read_Time_Async
+* Returns        : U8 ---> TWI_BUS_OK if queued, else TWI_BUS_ERR_FULL.
+* Arguments      : U8 *regs ---> DS1339A_TIME_REGS bytes, receive registers 0x00 to 0x06.
+*                  TWI_BUS_CB cb ---> Called from TWI0_Handler when the read ends.
+* Created by     : Anup Silvan Mascarenhas
+*
+* Description    : Queues the read of RTC_Read_Time without waiting. The
+*                  callback decodes regs with RTC_Cal_From_Regs.
+*
+* Notes          : regs must stay valid till the callback.
+* Global Variables Affected : NA
+*****************************************************************************/
+U8 RTC_Read_Time_Async(U8 *regs, TWI_BUS_CB cb)
+{
+	twi_package_t packet_read;
+	packet_read.addr[0] = DS1339A_SEC_REG;
+	packet_read.addr_length = 1;
+	packet_read.buffer = regs;
+	packet_read.length = DS1339A_TIME_REGS;
+	packet_read.chip = DS1339A_SLAVE_ADDRESS;
+	
+	return twi_bus_read_async(&packet_read, cb);
+}
+
 /*****************************************************************************
 * Function Name	: Write_Time_hhMMss_To_DS1339A
 * Returns       : void
@@ -686,9 +854,9 @@ void Write_Time_hhMMss_To_DS1339A(U8 hr, U8 mn, U8 ss)
 	U8 bcd_time_arr[3] = {0};
 	
 	// Convert seconds, minutes, and hours to BCD format
-	bcd_time_arr[0] = DecimalToBCD(ss);  // Convert seconds to BCD
-	bcd_time_arr[1] = DecimalToBCD(mn);  // Convert minutes to BCD
-	bcd_time_arr[2] = DecimalToBCD(hr);  // Convert hours to BCD
+	bcd_time_arr[0] = RTC_Cal_Bin_To_BCD(ss);  // Convert seconds to BCD
+	bcd_time_arr[1] = RTC_Cal_Bin_To_BCD(mn);  // Convert minutes to BCD
+	bcd_time_arr[2] = RTC_Cal_Bin_To_BCD(hr);  // Convert hours to BCD
 
 	// Setup I2C packet to write time data to DS1339A
 	twi_package_t packet_write;
@@ -699,7 +867,7 @@ void Write_Time_hhMMss_To_DS1339A(U8 hr, U8 mn, U8 ss)
 	packet_write.chip = DS1339A_SLAVE_ADDRESS; // Set the slave address for DS1339A
 	
 	// Perform the I2C write operation
-	if (twi_master_write(TWI0, &packet_write) != TWI_SUCCESS)
+	if (twi_bus_write(&packet_write) != TWI_SUCCESS)
 	{
 		#if (DEBUG_ALL || DEBUG_RTC)
 		Print_Message("\nTWI writing is unsuccessful."); // Print error message if write fails
@@ -731,10 +899,10 @@ void Write_DtMnYy_and_Day_To_DS1339A(U8 dt, U8 mon, U8 yr, U8 day)
 	U8 bcd_date_arr[4] = {0};
 	
 	// Convert day, date, month, and year to BCD format
-	bcd_date_arr[0] = DecimalToBCD(day);  // Convert day to BCD
-	bcd_date_arr[1] = DecimalToBCD(dt);   // Convert date to BCD
-	bcd_date_arr[2] = DecimalToBCD(mon);  // Convert month to BCD
-	bcd_date_arr[3] = DecimalToBCD(yr);   // Convert year to BCD
+	bcd_date_arr[0] = RTC_Cal_Bin_To_BCD(day);  // Convert day to BCD
+	bcd_date_arr[1] = RTC_Cal_Bin_To_BCD(dt);   // Convert date to BCD
+	bcd_date_arr[2] = RTC_Cal_Bin_To_BCD(mon);  // Convert month to BCD
+	bcd_date_arr[3] = RTC_Cal_Bin_To_BCD(yr);   // Convert year to BCD
 
 	// Setup I2C packet to write date, month, year, and day data to DS1339A
 	twi_package_t packet_write;
@@ -745,7 +913,7 @@ void Write_DtMnYy_and_Day_To_DS1339A(U8 dt, U8 mon, U8 yr, U8 day)
 	packet_write.chip = DS1339A_SLAVE_ADDRESS; // Set the slave address for DS1339A
 	
 	// Perform the I2C write operation
-	if (twi_master_write(TWI0, &packet_write) != TWI_SUCCESS)
+	if (twi_bus_write(&packet_write) != TWI_SUCCESS)
 	{
 		#if (DEBUG_ALL || DEBUG_RTC)
 		Print_Message("\nTWI writing is unsuccessful."); // Print error message if write fails
@@ -761,111 +929,40 @@ void Write_DtMnYy_and_Day_To_DS1339A(U8 dt, U8 mon, U8 yr, U8 day)
 * Arguments      : None
 * Created by     : Anup Silvan Mascarenhas
 *
-* Description    : Reads and prints the current time and date from the DS1339A RTC
-*                   if the RTC interrupt flag is set. The data is printed every
-*                   second if an alarm interrupt occurs.
-* Notes          : This function handles reading and printing RTC data when an interrupt
-*				   indicates that the data should be fetched.
-* Global Variables Affected : gb_rtc_1secInt_triggered_f
+* Description    : Prints the current time and date every second. The time
+*                   comes from the software clock (rtc_clock.c), no I2C
+*                   transfer; RTC_Clock_Task keeps it in step with the DS1339A.
+*                   The line is formatted in RAM and queued on the debug UART,
+*                   the call does not wait for it to be sent.
+* Notes          : Call RTC_Clock_Task from the main loop as well.
+* Global Variables Affected : gb_rtc_clock_sec_f
 *****************************************************************************/
 void Get_RTC_Data_At_Every_Second(void)
 {
-	U8 lcl_rtc_read_f = 0;  // Local flag to indicate if RTC data should be read
-
-	// Check if the RTC interrupt flag is set
-	if ((gb_rtc_1secInt_triggered_f == 1) || (gb_read_stsReg_at_pwrOn_f == 1))
+	RTC_TIME time;
+	char line[1 + RTC_CAL_ISO8601_LEN + 10];	// Newline, time, space and the longest day name.
+	const char *name;
+	U8 len, name_len;
+	
+	// Check if the software clock entered a new second
+	if (gb_rtc_clock_sec_f == 1)
 	{
-		U8 status_reg = 0;
-		status_reg = Read_Status_Register();  // Read the status register to check for interrupts
-
-		// Check if the alarm interrupt flag (bit 0) is set in the status register
-		if (status_reg & 0x01)
+		gb_rtc_clock_sec_f = 0;
+		if (RTC_Clock_Get(&time) != RTC_CLOCK_OK)
 		{
-			gb_rtc_1secInt_triggered_f = 0;  // Reset RTC interrupt flags
-			gb_read_stsReg_at_pwrOn_f = 0;
-			
-			uint8_t clear_flag;  // Variable to hold the status register value after clearing the interrupt flag
-			// Clear the alarm interrupt flag in the status register
-			clear_flag = status_reg & 0xFE;  // Clear the least significant bit (alarm interrupt flag)
-			Write_To_Status_Register(clear_flag);  // Write back the cleared status register value
-			
-			lcl_rtc_read_f = 1;  // Set flag to read RTC data
+			return;
 		}
-	}
-
-	// If RTC data needs to be read
-	if (lcl_rtc_read_f == 1)
-	{
-		lcl_rtc_read_f = 0;  // Reset the local RTC read flag
-		
-		gb_rtcTimeArr[0] = Read_Hour_From_DS1339A();
-		gb_rtcTimeArr[1] = Read_Minutes_From_DS1339A();
-		gb_rtcTimeArr[2] = Read_Seconds_From_DS1339A();
+		RTC_Update_Time_Arrays(&time);
 		
-		gb_rtcDateArr[0] = Read_Date_From_DS1339A();
-		gb_rtcDateArr[1] = Read_Month_From_DS1339A();
-		gb_rtcDateArr[2] = Read_Year_From_DS1339A();
-		gb_rtcDateArr[3] = Read_DayValue_From_DS1339A();
-		
-		#if 1
-		// Print the time
-		Print_Message("\nTime       : HH:MM:SS   | ");
-		if (gb_rtcTimeArr[0] < 10)
-		Print_Number(0);	// Print Dummy.
-		Print_Number(gb_rtcTimeArr[0]);    // Read and print the hour
-		Print_Message(":");
-		if (gb_rtcTimeArr[1] < 10)
-		Print_Number(0);	// Print Dummy.
-		Print_Number(gb_rtcTimeArr[1]); // Read and print the minutes
-		Print_Message(":");
-		if (gb_rtcTimeArr[2] < 10)
-		Print_Number(0);	// Print Dummy.
-		Print_Number(gb_rtcTimeArr[2]); // Read and print the seconds
-
-		// Print the date
-		Print_Message("\nDate       : DD:MM:YYYY | ");
-		if (gb_rtcDateArr[0] < 10)
-		Print_Number(0);	// Print Dummy.
-		Print_Number(gb_rtcDateArr[0]);   // Read and print the date
-		Print_Message(":");
-		if (gb_rtcDateArr[1] < 10)
-		Print_Number(0);	// Print Dummy.
-		Print_Number(gb_rtcDateArr[1]);  // Read and print the month
-		Print_Message(":20");
-		Print_Number(gb_rtcDateArr[2]);   // Read and print the year
-		
-		// Print day of the week
-		Print_Message("\nWeekday is : ---- ");
-		Print_Number(gb_rtcDateArr[3]);
-		Print_Message(" --- | ");
-		switch (gb_rtcDateArr[3])
-		{
-			case 1:
-				Print_Message("Sunday.");
-			break;
-			case 2:
-				Print_Message("Monday.");
-			break;
-			case 3:
-				Print_Message("Tuesday.");
-			break;
-			case 4:
-				Print_Message("Wednesday.");
-			break;
-			case 5:
-				Print_Message("Thursday.");
-			break;
-			case 6:
-				Print_Message("Friday.");
-			break;
-			case 7:
-				Print_Message("Saturday.");
-			break;
-			default:
-				Print_Message("Holiday");
-			break;
-		}
-		#endif
+		// One line, e.g. "2024-05-01T12:34:56 Wednesday", queued for UART0_Handler
+		line[0] = '\n';
+		len = 1 + RTC_Cal_Format_ISO8601(&time, RTC_CAL_NO_MS, &line[1]);
+		line[len ++] = ' ';
+		name = rtc_weekday_name[(time.day <= 7) ? time.day : 0];
+		name_len = strlen(name);
+		memcpy(&line[len], name, name_len);
+		len += name_len;
+		UART_Debug_Write_Async((const U8 *)line, len);
 		
 		static int send_f;
 		send_f ++;
@@ -943,6 +1040,8 @@ void Update_Time_And_Date(void)
 	{
 		Write_DtMnYy_and_Day_To_DS1339A(rtcUpdateArr[2], rtcUpdateArr[3], rtcUpdateArr[4], rtcUpdateArr[5]);
 	}
+	
+	RTC_Clock_Request_Sync();  // Software clock takes the new time on the next RTC_Clock_Task
 }
 
 /**************************************************************************************************
@@ -954,40 +1053,25 @@ void Get_RTC_Data(void)
 {
 	U8 lcl_rtc_read_f = 0;  // Local flag to indicate if RTC data should be read
 
-	// Check if the RTC interrupt flag is set
-	if ((gb_rtc_1secInt_triggered_f == 1) || (gb_read_stsReg_at_pwrOn_f == 1))
+	// Check if the RTC 1 Hz interrupt flag is set, the test firmware reads the DS1339A itself
+	if (gb_rtc_1secInt_triggered_f == 1)
 	{
-		U8 status_reg = 0;
-		status_reg = Read_Status_Register();  // Read the status register to check for interrupts
-
-		// Check if the alarm interrupt flag (bit 0) is set in the status register
-		if (status_reg & 0x01)
-		{
-			gb_rtc_1secInt_triggered_f = 0;  // Reset RTC interrupt flags
-			gb_read_stsReg_at_pwrOn_f = 0;
-			
-			uint8_t clear_flag;  // Variable to hold the status register value after clearing the interrupt flag
-			// Clear the alarm interrupt flag in the status register
-			clear_flag = status_reg & 0xFE;  // Clear the least significant bit (alarm interrupt flag)
-			Write_To_Status_Register(clear_flag);  // Write back the cleared status register value
-			
-			lcl_rtc_read_f = 1;  // Set flag to read RTC data
-		}
+		gb_rtc_1secInt_triggered_f = 0;  // Reset RTC interrupt flag
+		lcl_rtc_read_f = 1;  // Set flag to read RTC data
 	}
 
 	// If RTC data needs to be read
 	if (lcl_rtc_read_f == 1)
 	{
-		lcl_rtc_read_f = 0;  // Reset the local RTC read flag
+		RTC_TIME time;
 		
-		gb_rtcTimeArr[0] = Read_Hour_From_DS1339A();
-		gb_rtcTimeArr[1] = Read_Minutes_From_DS1339A();
-		gb_rtcTimeArr[2] = Read_Seconds_From_DS1339A();
+		lcl_rtc_read_f = 0;  // Reset the local RTC read flag
 		
-		gb_rtcDateArr[0] = Read_Date_From_DS1339A();
-		gb_rtcDateArr[1] = Read_Month_From_DS1339A();
-		gb_rtcDateArr[2] = Read_Year_From_DS1339A();
-		gb_rtcDateArr[3] = Read_DayValue_From_DS1339A();
+		if (RTC_Read_Time(&time) != TWI_SUCCESS)  // All time registers in one transfer
+		{
+			return;
+		}
+		RTC_Update_Time_Arrays(&time);
 		
 		#if 1
 		// Print the date
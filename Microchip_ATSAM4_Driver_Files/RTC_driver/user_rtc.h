@@ -12,10 +12,41 @@
 #ifndef USER_RTC_H
 #define USER_RTC_H
 
+#include "user_i2c.h"
+
+#define DS1339A_TIME_REGS	(7)		// Registers 0x00 (seconds) to 0x06 (year).
+
+/***** DS1339A time registers, index into the register block *****/
+#define DS1339A_SEC_REG		(0x00)
+#define DS1339A_MIN_REG		(0x01)
+#define DS1339A_HOUR_REG	(0x02)
+#define DS1339A_DAY_REG		(0x03)
+#define DS1339A_DATE_REG	(0x04)
+#define DS1339A_MONTH_REG	(0x05)
+#define DS1339A_YEAR_REG	(0x06)
+
+#define DS1339A_HOUR_12H	(0x40)		// Hour register : 12 hour mode.
+#define DS1339A_HOUR_PM		(0x20)		// Hour register : PM in 12 hour mode.
+#define DS1339A_CENTURY		(0x80)		// Month register : century bit.
+
+/***** Structure Declarations *****/
+typedef struct
+{
+	U8 sec;					// 0 to 59.
+	U8 min;					// 0 to 59.
+	U8 hour;				// 0 to 23, also when the DS1339A runs in 12 hour mode.
+	U8 day;					// Day of the week, 1 (Sunday) to 7.
+	U8 date;				// 1 to 31.
+	U8 month;				// 1 to 12.
+	U8 year;				// 0 to 99.
+	U8 century;				// Century bit of the month register.
+}RTC_TIME;
+
 /***** Extern / Global Variable *****/
 extern U8 gb_rtc_send_to_server_f;
 extern U8 gb_rtcTimeArr[3];
 extern U8 gb_rtcDateArr[4];
+extern U32 gb_rtcEpoch;				// Last reading, seconds since 1970-01-01.
 extern U8 rtcUpdateArr[6];
 extern U8 gb_rtc_time_update_f;
 
@@ -23,6 +54,11 @@ extern U8 gb_rtc_time_update_f;
 void RTC_Interrupt_Pin_Configure(void);
 void Get_RTC_Data_At_Every_Second(void);
 void Get_RTC_Data(void);
+uint32_t RTC_Read_Time(RTC_TIME *time);
+uint32_t RTC_Write_Time(const RTC_TIME *time);
+U8 RTC_Read_Time_Async(U8 *regs, TWI_BUS_CB cb);
+uint32_t RTC_Set_Alarm1(const RTC_TIME *time);
+void RTC_Clear_Alarm_Flags(void);
 
 void Write_Seconds_To_DS1339A(uint8_t sec);
 void Write_Minutes_To_DS1339A(uint8_t min);
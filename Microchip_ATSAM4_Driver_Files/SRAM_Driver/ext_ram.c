@@ -26,7 +26,13 @@ uint32_t rm_byte_add = 0;				// Holds the starting address of the bytes to write
 STS_REG RAM_STS_REG;
 RAM_MEM ramMem;
 
+volatile uint8_t gb_extRAM_dma_busy_f = 0;	// Flag sets while PDC requests are queued or on the SPI bus (ext_ram_dma.c).
+volatile uint8_t gb_extRAM_cpu_owner_f = 0;	// Flag sets while a blocking transfer owns the SPI bus, queued PDC requests wait.
+static uint8_t rm_cur_mode = extRAM_MODE_UNKNOWN;	// Last mode written to / read from the mode register.
+
 static uint8_t check_error(uint32_t page_num, uint16_t rm_byte_add, uint16_t len);
+static void extRAM_Bus_Claim(void);
+static void extRAM_Bus_Release(void);
 
 /*****************************************************************************
 * Function name	: void Configure_CS_Pin_For_extRAM(void)
@@ -65,10 +71,12 @@ uint8_t* extRAM_Read_Status_Register(void)
 	CS2_PIN_LOW;
 	//delay_ms(1);
 	U8 stf = Data_To_SPI(rm_command_data, 1);
-	while (!spi_is_tx_empty(SPI));
-	spi_read_packet(SPI, ram_read_arr, 2);
+	Wait_SPI_TX_Empty();
+	Data_From_SPI(ram_read_arr, 2);
 	//delay_ms(1);
 	CS2_PIN_HIGH;
+
+	rm_cur_mode = ram_read_arr[0] & extRAM_MODE_MASK;	// Keep the cached mode in step with the device.
 	
 	#if extRAM_DEBUG_STATUS_REG
 	for (U8 idx = 0; idx < 2; idx ++)
@@ -103,8 +111,86 @@ void extRAM_Write_Status_Register(STS_REG *stsReg)
 	Data_To_SPI(rm_command_data, 1);
 	//while (!spi_is_tx_empty(SPI));
 	Data_To_SPI(stsReg->data_arr, stsReg->data_len);
-	//while (!spi_is_tx_empty(SPI));
+	Wait_SPI_TX_Empty();	// Chip select must stay low till the mode byte is shifted out.
 	CS2_PIN_HIGH;
+
+	rm_cur_mode = stsReg->data_arr[0] & extRAM_MODE_MASK;
+}
+
+/*****************************************************************************************
+* Function name	: void extRAM_Set_Mode(uint8_t mode)
+* Returns		: Nothing.
+* Arguments		: uint8_t mode ---> extRAM_MODE_BYTE, extRAM_MODE_PAGE or
+*				  extRAM_MODE_SEQUENTIAL.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Writes the mode register only when the cached mode differs.
+*               :
+* Notes			: NA
+* Global Variables Affected	: RAM_STS_REG
+******************************************************************************************/
+void extRAM_Set_Mode(uint8_t mode)
+{
+	if (mode == rm_cur_mode)
+	{
+		return;
+	}
+
+	RAM_STS_REG.data_arr[0] = mode;
+	RAM_STS_REG.data_len = 1;
+	extRAM_Write_Status_Register(&RAM_STS_REG);
+}
+
+/*****************************************************************************************
+* Function name	: uint8_t extRAM_Get_Mode(void)
+* Returns		: uint8_t ---> Cached mode, extRAM_MODE_UNKNOWN before the first
+*				  mode register access.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Returns the mode the driver believes the RAM is in.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+******************************************************************************************/
+uint8_t extRAM_Get_Mode(void)
+{
+	return rm_cur_mode;
+}
+
+/*****************************************************************************************
+* Function name	: void extRAM_Select_Mode(uint32_t adds, uint32_t len)
+* Returns		: Nothing.
+* Arguments		: uint32_t adds ---> Start address of the coming transfer.
+*				  uint32_t len ---> Length of the coming transfer.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Makes sure the coming transfer completes in one chip select.
+*				  Single byte		---> any mode.
+*				  Inside one page	---> page or sequential mode.
+*				  Crosses a page	---> sequential mode.
+*				  The mode register is written only when the current mode would
+*				  split or wrap the transfer, so back to back transfers of the
+*				  same kind cost no extra command.
+*               :
+* Notes			: Called by every read / write of this driver and ext_ram_dma.c.
+* Global Variables Affected	: NA
+******************************************************************************************/
+void extRAM_Select_Mode(uint32_t adds, uint32_t len)
+{
+	if (len <= 1)
+	{
+		return;
+	}
+
+	if ((adds / extRAM_PAGE_SIZE) == ((adds + len - 1) / extRAM_PAGE_SIZE))
+	{
+		if ((rm_cur_mode != extRAM_MODE_PAGE) && (rm_cur_mode != extRAM_MODE_SEQUENTIAL))
+		{
+			extRAM_Set_Mode(extRAM_MODE_PAGE);
+		}
+	}
+	else
+	{
+		extRAM_Set_Mode(extRAM_MODE_SEQUENTIAL);
+	}
 }
 
  /*****************************************************************************************
@@ -219,6 +305,213 @@ void extRAM_Write_Status_Register(STS_REG *stsReg)
 
 */
 
+/*****************************************************************************************
+* Function name	: uint8_t extRAM_Check_Range(uint32_t adds, uint32_t len)
+* Returns		: uint8_t ---> extRAM_OK, extRAM_ERR_ADDRESS or extRAM_ERR_LENGTH.
+* Arguments		: uint32_t adds ---> Start address inside the external RAM.
+*				  uint32_t len ---> Number of bytes to be transferred.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Checks that a transfer of len bytes from adds stays inside the device.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+******************************************************************************************/
+uint8_t extRAM_Check_Range(uint32_t adds, uint32_t len)
+{
+	if (adds >= extRAM_MX_BYTE_SIZE)
+	{
+		#if extRAM_DEBUG_ERROR
+		Print_Message("\nAddress is greater than extRAM_MX_BYTE_SIZE");
+		#endif
+		return extRAM_ERR_ADDRESS;
+	}
+	if ((len < 1) || (len > (extRAM_MX_BYTE_SIZE - adds)))
+	{
+		#if extRAM_DEBUG_ERROR
+		Print_Message("\nAddress & Length can't be greater than extRAM_MX_BYTE_SIZE");
+		#endif
+		return extRAM_ERR_LENGTH;
+	}
+
+	return extRAM_OK;
+}
+
+/*****************************************************************************************
+* Function name	: void extRAM_Load_Command(uint8_t *cmd_buf, uint8_t cmd, uint32_t adds)
+* Returns		: NA
+* Arguments		: uint8_t *cmd_buf ---> 4 byte buffer to fill.
+*				  uint8_t cmd ---> Read or write command.
+*				  uint32_t adds ---> 24 bit start address.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Fills cmd_buf with the command and the 3 address bytes.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+******************************************************************************************/
+void extRAM_Load_Command(uint8_t *cmd_buf, uint8_t cmd, uint32_t adds)
+{
+	cmd_buf[0] = cmd;
+	cmd_buf[1] = (uint8_t)((adds & 0x00FF0000) >> 16) ;
+	cmd_buf[2] = (uint8_t)((adds & 0x0000FF00) >> 8) ;
+	cmd_buf[3] = (uint8_t)((adds & 0x000000FF)) ;
+}
+
+/*****************************************************************************************
+* Function name	: uint8_t extRAM_Write(uint32_t adds, const uint8_t *data, uint32_t len)
+* Returns		: uint8_t ---> extRAM_OK, else extRAM_ERR_ADDRESS / extRAM_ERR_LENGTH.
+* Arguments		: uint32_t adds ---> Start address inside the external RAM.
+*				  const uint8_t *data ---> Caller buffer holding the data to write.
+*				  uint32_t len ---> Number of bytes to write.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Writes len bytes straight from the caller buffer in a single chip
+*				  select assertion. No copy is made and no limit applies other than
+*				  the size of the device.
+*               :
+* Notes			: The RAM mode is selected automatically by extRAM_Select_Mode.
+* Global Variables Affected	: NA
+******************************************************************************************/
+uint8_t extRAM_Write(uint32_t adds, const uint8_t *data, uint32_t len)
+{
+	RAM_SEG seg;
+
+	seg.data = (uint8_t *)data;
+	seg.len = len;
+
+	return extRAM_Write_SG(adds, &seg, 1);
+}
+
+/*****************************************************************************************
+* Function name	: uint8_t extRAM_Read(uint32_t adds, uint8_t *data, uint32_t len)
+* Returns		: uint8_t ---> extRAM_OK, else extRAM_ERR_ADDRESS / extRAM_ERR_LENGTH.
+* Arguments		: uint32_t adds ---> Start address inside the external RAM.
+*				  uint8_t *data ---> Caller buffer to read into.
+*				  uint32_t len ---> Number of bytes to read.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Reads len bytes straight into the caller buffer in a single chip
+*				  select assertion.
+*               :
+* Notes			: The RAM mode is selected automatically by extRAM_Select_Mode.
+* Global Variables Affected	: NA
+******************************************************************************************/
+uint8_t extRAM_Read(uint32_t adds, uint8_t *data, uint32_t len)
+{
+	RAM_SEG seg;
+
+	seg.data = data;
+	seg.len = len;
+
+	return extRAM_Read_SG(adds, &seg, 1);
+}
+
+/*****************************************************************************************
+* Function name	: uint8_t extRAM_Write_SG(uint32_t adds, const RAM_SEG *seg, uint8_t seg_cnt)
+* Returns		: uint8_t ---> extRAM_OK, else extRAM_ERR_ADDRESS / extRAM_ERR_LENGTH.
+* Arguments		: uint32_t adds ---> Start address inside the external RAM.
+*				  const RAM_SEG *seg ---> List of caller buffers (gather list).
+*				  uint8_t seg_cnt ---> Number of entries in the list.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Gathers the segments one after another into consecutive RAM
+*				  addresses starting at adds. The command is sent once and all
+*				  segments are clocked out under the same chip select.
+*               :
+* Notes			: Segments with zero length are skipped. Waits for queued PDC
+*				  requests, must not be called from a DMA callback.
+* Global Variables Affected	: NA
+******************************************************************************************/
+uint8_t extRAM_Write_SG(uint32_t adds, const RAM_SEG *seg, uint8_t seg_cnt)
+{
+	uint32_t total_len = 0;
+	uint8_t sts;
+
+	#if extRAM_DEBUG_WRITE
+	Print_Message("\nInside extRAM_Write_SG Function.");
+	#endif
+
+	for (uint8_t sIdx = 0; sIdx < seg_cnt; sIdx ++)
+	{
+		total_len += seg[sIdx].len;
+	}
+
+	sts = extRAM_Check_Range(adds, total_len);
+	if (sts != extRAM_OK)
+	{
+		return sts;
+	}
+
+	extRAM_Bus_Claim();
+	extRAM_Select_Mode(adds, total_len);
+	extRAM_Load_Command(rm_command_data, extRAM_WRITE_TO_MEM, adds);
+
+	CS2_PIN_LOW;
+	Data_To_SPI(rm_command_data, 4);
+	for (uint8_t sIdx = 0; sIdx < seg_cnt; sIdx ++)
+	{
+		if (seg[sIdx].len > 0)
+		{
+			Data_To_SPI(seg[sIdx].data, seg[sIdx].len);
+		}
+	}
+	Wait_SPI_TX_Empty();
+	CS2_PIN_HIGH;
+	extRAM_Bus_Release();
+
+	return extRAM_OK;
+}
+
+/*****************************************************************************************
+* Function name	: uint8_t extRAM_Read_SG(uint32_t adds, const RAM_SEG *seg, uint8_t seg_cnt)
+* Returns		: uint8_t ---> extRAM_OK, else extRAM_ERR_ADDRESS / extRAM_ERR_LENGTH.
+* Arguments		: uint32_t adds ---> Start address inside the external RAM.
+*				  const RAM_SEG *seg ---> List of caller buffers (scatter list).
+*				  uint8_t seg_cnt ---> Number of entries in the list.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Reads consecutive RAM addresses starting at adds and scatters
+*				  them into the segments in order, under one chip select.
+*               :
+* Notes			: Segments with zero length are skipped. Waits for queued PDC
+*				  requests, must not be called from a DMA callback.
+* Global Variables Affected	: NA
+******************************************************************************************/
+uint8_t extRAM_Read_SG(uint32_t adds, const RAM_SEG *seg, uint8_t seg_cnt)
+{
+	uint32_t total_len = 0;
+	uint8_t sts;
+
+	#if extRAM_DEBUG_READ
+	Print_Message("\nInside extRAM_Read_SG Function.");
+	#endif
+
+	for (uint8_t sIdx = 0; sIdx < seg_cnt; sIdx ++)
+	{
+		total_len += seg[sIdx].len;
+	}
+
+	sts = extRAM_Check_Range(adds, total_len);
+	if (sts != extRAM_OK)
+	{
+		return sts;
+	}
+
+	extRAM_Bus_Claim();
+	extRAM_Select_Mode(adds, total_len);
+	extRAM_Load_Command(rm_command_data, extRAM_READ_MEMORY, adds);
+
+	CS2_PIN_LOW;
+	Data_To_SPI(rm_command_data, 4);
+	Wait_SPI_TX_Empty();
+	for (uint8_t sIdx = 0; sIdx < seg_cnt; sIdx ++)
+	{
+		if (seg[sIdx].len > 0)
+		{
+			Data_From_SPI(seg[sIdx].data, seg[sIdx].len);
+		}
+	}
+	CS2_PIN_HIGH;
+	extRAM_Bus_Release();
+
+	return extRAM_OK;
+}
+
 /*****************************************************************************************
 * Function name	: void extRAM_Write_To_Memory(RAM_MEM *writeMem)
 * Returns		: NA
@@ -226,7 +519,7 @@ void extRAM_Write_Status_Register(STS_REG *stsReg)
 * Created by	: Anup Silvan Mascarenhas
 * Description	: Function is written to write and save inside external memory 
 *               :
-* Notes			: NA
+* Notes			: Kept for existing callers, new code should use extRAM_Write().
 * Global Variables Affected	: NA
 *******************************************************************************************/
 void extRAM_Write_To_Memory(RAM_MEM *writeMem)
@@ -235,19 +528,7 @@ void extRAM_Write_To_Memory(RAM_MEM *writeMem)
 	Print_Message("\nInside extRAM_Write_To_Memory Function.");
 	#endif
 
-	rm_command_data[0] = extRAM_WRITE_TO_MEM;
-	
-	rm_command_data[1] = (uint8_t)((writeMem->regAdds & 0x00FF0000) >> 16) ;
-	rm_command_data[2] = (uint8_t)((writeMem->regAdds & 0x0000FF00) >> 8) ;
-	rm_command_data[3] = (uint8_t)((writeMem->regAdds & 0x000000FF)) ;
-	
-	CS2_PIN_LOW;
-	//delay_ms(1);
-	Data_To_SPI(rm_command_data, 4);
-	while (!spi_is_tx_empty(SPI));
-	Data_To_SPI(writeMem->data_arr, writeMem->data_len);
-	while (!spi_is_tx_empty(SPI));
-	CS2_PIN_HIGH;
+	extRAM_Write(writeMem->regAdds, writeMem->data_arr, writeMem->data_len);
 }
 /*****************************************************************************************
 * Function name	: void extRAM_Read_From_Memory(RAM_MEM *readMem)
@@ -256,7 +537,7 @@ void extRAM_Write_To_Memory(RAM_MEM *writeMem)
 * Created by	: Anup Silvan Mascarenhas
 * Description	: Function is written to Read from external memory 
 *               :
-* Notes			: NA
+* Notes			: Kept for existing callers, new code should use extRAM_Read().
 * Global Variables Affected	: NA
 *******************************************************************************************/
 void extRAM_Read_From_Memory(RAM_MEM *readMem)
@@ -265,18 +546,55 @@ void extRAM_Read_From_Memory(RAM_MEM *readMem)
 	Print_Message("\nInside extRAM_Read_From_Memory Function.");
 	#endif
 
-	rm_command_data[0] = extRAM_READ_MEMORY;
-	
-	rm_command_data[1] = (uint8_t)((readMem->regAdds & 0x00FF0000) >> 16) ;
-	rm_command_data[2] = (uint8_t)((readMem->regAdds & 0x0000FF00) >> 8) ;
-	rm_command_data[3] = (uint8_t)((readMem->regAdds & 0x000000FF)) ;
+	extRAM_Read(readMem->regAdds, readMem->data_arr, readMem->data_len);
+}
+/*****************************************************************************
+* Function name	: static void extRAM_Bus_Claim(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Waits till the queued PDC requests are done and takes the bus
+*				  for a blocking transfer. The check and the claim are made with
+*				  the SPI interrupt masked, so a request queued afterwards (also
+*				  from an interrupt) waits in the queue instead of pulling chip
+*				  select low in the middle of the transfer.
+*               :
+* Notes			: Never returns in SPI_Handler (a DMA callback), the queue it
+*				  waits for is only run by that handler.
+* Global Variables Affected	: gb_extRAM_cpu_owner_f
+*****************************************************************************/
+static void extRAM_Bus_Claim(void)
+{
+	Assert(__get_IPSR() != (SPI_IRQn + 16));	// DMA callbacks may only queue requests.
 
-	CS2_PIN_LOW;
-	//delay_ms(1);
-	Data_To_SPI(rm_command_data, 4);
-	while (!spi_is_tx_empty(SPI));
-	spi_read_packet(SPI, readMem->data_arr , readMem->data_len);
-	/***** Wait till the reception complete. *****/
-	//delay_ms(1);
-	CS2_PIN_HIGH;
-}
\ No newline at end of file
+	NVIC_DisableIRQ(SPI_IRQn);
+	while (gb_extRAM_dma_busy_f)
+	{
+		NVIC_EnableIRQ(SPI_IRQn);
+		NVIC_DisableIRQ(SPI_IRQn);
+	}
+	gb_extRAM_cpu_owner_f = 1;
+	NVIC_EnableIRQ(SPI_IRQn);
+}
+
+/*****************************************************************************
+* Function name	: static void extRAM_Bus_Release(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Gives the bus back after a blocking transfer. PDC requests
+*				  queued meanwhile are started by pending SPI_Handler.
+*               :
+* Notes			: NA
+* Global Variables Affected	: gb_extRAM_cpu_owner_f
+*****************************************************************************/
+static void extRAM_Bus_Release(void)
+{
+	NVIC_DisableIRQ(SPI_IRQn);
+	gb_extRAM_cpu_owner_f = 0;
+	if (gb_extRAM_dma_busy_f)
+	{
+		NVIC_SetPendingIRQ(SPI_IRQn);
+	}
+	NVIC_EnableIRQ(SPI_IRQn);
+}
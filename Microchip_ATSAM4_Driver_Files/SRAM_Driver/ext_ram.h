@@ -33,6 +33,14 @@
 #define Data_To_SPI(data, len)	(spi_write_packet(SPI, data, len))
 #endif
 
+#ifndef Data_From_SPI
+#define Data_From_SPI(data, len)	(spi_read_packet(SPI, data, len))
+#endif
+
+#ifndef Wait_SPI_TX_Empty
+#define Wait_SPI_TX_Empty()		while (!spi_is_tx_empty(SPI))
+#endif
+
 #ifndef extRAM_MX_BYTE_SIZE
 #define extRAM_MX_BYTE_SIZE	512000	//7D000 (Hex) //Bytes // Maximum bytes that RAM has is (4MBit).
 #endif
@@ -45,6 +53,17 @@
 #define extRAM_MAX_PAGES (extRAM_MX_BYTE_SIZE / extRAM_PAGE_SIZE)
 #endif
 
+/***** Return Codes *****/
+#define extRAM_OK					0	// Transfer completed.
+#define extRAM_ERR_ADDRESS			1	// Start address is outside the device.
+#define extRAM_ERR_LENGTH			2	// Zero length or transfer runs past the end of the device.
+#define extRAM_ERR_BUSY				3	// Request queue is full.
+#define extRAM_ERR_HANDLE			4	// Handle was not returned by ext_ram_alloc.c or is already free.
+#define extRAM_ERR_FULL				5	// FIFO has no room for the record.
+#define extRAM_ERR_EMPTY			6	// FIFO holds no record.
+#define extRAM_ERR_VERIFY			7	// Read back data differs from the written pattern (ext_ram_test.c).
+/***** End of Return Codes *****/
+
 /***** Command Definitions *****/
 #define extRAM_CMD_READ_SR			0x05	// Read status register.
 #define extRAM_CMD_WRITE_SR			0x01	// Read status register.
@@ -52,6 +71,14 @@
 #define extRAM_READ_MEMORY			0x03	// Read memory.
 /***** End of command Definitions *****/
 
+/***** Operating Modes (bits 7:6 of the mode register) *****/
+#define extRAM_MODE_BYTE			0x00	// Single byte per command.
+#define extRAM_MODE_PAGE			0x80	// Wraps inside the extRAM_PAGE_SIZE page.
+#define extRAM_MODE_SEQUENTIAL		0x40	// Continues through the whole array.
+#define extRAM_MODE_MASK			0xC0
+#define extRAM_MODE_UNKNOWN			0xFF	// Mode register not accessed since reset.
+/***** End of Operating Modes *****/
+
 /***** DEBUG MESSAGES *****/
 #define extRAM_DEBUG_STATUS_REG		(0)
 #define extRAM_DEBUG_PWRITE			(0)
@@ -76,12 +103,31 @@ typedef struct
 	U16 data_len;
 }RAM_MEM;
 
+/* One piece of caller memory in a scatter-gather transfer. */
+typedef struct
+{
+	U8 *data;		// Caller buffer for this segment.
+	U32 len;		// Number of bytes in this segment.
+}RAM_SEG;
+
 extern STS_REG RAM_STS_REG;
 extern RAM_MEM ramMem;
+extern volatile U8 gb_extRAM_dma_busy_f;
+extern volatile U8 gb_extRAM_cpu_owner_f;
 
 /***** Function Prototypes *****/
 void Configure_CS_Pin_For_extRAM(void);
 void extRAM_Write_To_Memory(RAM_MEM *writeMem);
 void extRAM_Read_From_Memory(RAM_MEM *readMem);
 U8* extRAM_Read_Status_Register(void);
+void extRAM_Write_Status_Register(STS_REG *stsReg);
+void extRAM_Set_Mode(U8 mode);
+U8 extRAM_Get_Mode(void);
+void extRAM_Select_Mode(U32 adds, U32 len);
+U8 extRAM_Check_Range(U32 adds, U32 len);
+void extRAM_Load_Command(U8 *cmd_buf, U8 cmd, U32 adds);
+U8 extRAM_Write(U32 adds, const U8 *data, U32 len);
+U8 extRAM_Read(U32 adds, U8 *data, U32 len);
+U8 extRAM_Write_SG(U32 adds, const RAM_SEG *seg, U8 seg_cnt);
+U8 extRAM_Read_SG(U32 adds, const RAM_SEG *seg, U8 seg_cnt);
 #endif /* EXT_RAM_H_ */
\ No newline at end of file
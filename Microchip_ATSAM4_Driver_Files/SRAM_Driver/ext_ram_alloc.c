@@ -0,0 +1,505 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_alloc.c
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Allocator for the external RAM address space. The space between
+*				  extRAM_HEAP_BASE and extRAM_HEAP_END is split into fixed size
+*				  block pools (for frequently used object types) followed by a
+*				  bump arena (for per-session scratch). Only bookkeeping lives in
+*				  internal RAM, the data stays in the external RAM and is accessed
+*				  with extRAM_Handle_Write / extRAM_Handle_Read.
+*
+* Controller	: 	ATSAM4E16CA-AUR
+*					1024 KB		Flash.
+*					128 KB		RAM.
+*
+*****************************************************************************/
+
+#include "ext_ram_alloc.h"
+#include "string.h"
+#include "user_uart.h"
+
+#define BITMAP_WORDS(cnt)	(((cnt) + 31) / 32)
+
+typedef struct
+{
+	U32 base;			// First RAM address of the pool.
+	U32 *bitmap;		// One bit per block, 1 = allocated.
+	U16 *req_size;		// Requested size of each live block.
+	RAM_POOL_STATS st;
+}RAM_POOL;
+
+/***** Local variables *****/
+static U32 pool0_bitmap[BITMAP_WORDS(extRAM_POOL0_BLK_COUNT)];
+static U32 pool1_bitmap[BITMAP_WORDS(extRAM_POOL1_BLK_COUNT)];
+static U32 pool2_bitmap[BITMAP_WORDS(extRAM_POOL2_BLK_COUNT)];
+static U32 pool3_bitmap[BITMAP_WORDS(extRAM_POOL3_BLK_COUNT)];
+static U16 pool0_req_size[extRAM_POOL0_BLK_COUNT];
+static U16 pool1_req_size[extRAM_POOL1_BLK_COUNT];
+static U16 pool2_req_size[extRAM_POOL2_BLK_COUNT];
+static U16 pool3_req_size[extRAM_POOL3_BLK_COUNT];
+
+static RAM_POOL ram_pools[extRAM_POOL_COUNT];
+static U32 arena_base = 0;		// First RAM address of the arena.
+static U32 arena_top = 0;		// Next free arena address.
+static RAM_ARENA_STATS arena_st;
+
+static void extRAM_Pool_Setup(U8 pool, U32 base, U16 blk_size, U16 blk_count, U32 *bitmap, U16 *req_size);
+static RAM_POOL* extRAM_Find_Pool(extRAM_HANDLE hdl);
+static U32 extRAM_Handle_Limit(extRAM_HANDLE hdl);
+
+/*****************************************************************************
+* Function name	: void extRAM_Alloc_Init(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Lays the pools out one after another from extRAM_HEAP_BASE and
+*				  gives the rest up to extRAM_HEAP_END to the arena. All blocks
+*				  are free and statistics are cleared.
+*               :
+* Notes			: Handles issued before a call to this function become invalid.
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_Alloc_Init(void)
+{
+	U32 adds = extRAM_HEAP_BASE;
+
+	extRAM_Pool_Setup(0, adds, extRAM_POOL0_BLK_SIZE, extRAM_POOL0_BLK_COUNT, pool0_bitmap, pool0_req_size);
+	adds += (U32)extRAM_POOL0_BLK_SIZE * extRAM_POOL0_BLK_COUNT;
+	extRAM_Pool_Setup(1, adds, extRAM_POOL1_BLK_SIZE, extRAM_POOL1_BLK_COUNT, pool1_bitmap, pool1_req_size);
+	adds += (U32)extRAM_POOL1_BLK_SIZE * extRAM_POOL1_BLK_COUNT;
+	extRAM_Pool_Setup(2, adds, extRAM_POOL2_BLK_SIZE, extRAM_POOL2_BLK_COUNT, pool2_bitmap, pool2_req_size);
+	adds += (U32)extRAM_POOL2_BLK_SIZE * extRAM_POOL2_BLK_COUNT;
+	extRAM_Pool_Setup(3, adds, extRAM_POOL3_BLK_SIZE, extRAM_POOL3_BLK_COUNT, pool3_bitmap, pool3_req_size);
+	adds += (U32)extRAM_POOL3_BLK_SIZE * extRAM_POOL3_BLK_COUNT;
+
+	arena_base = adds;
+	arena_top = adds;
+	memset(&arena_st, 0, sizeof(arena_st));
+	arena_st.size = extRAM_HEAP_END - adds;
+
+	#if extRAM_DEBUG_ALLOC
+	Print_Message("\nextRAM arena starts at : ");
+	Print_Number(arena_base);
+	Print_Message("\nextRAM arena size : ");
+	Print_Number(arena_st.size);
+	#endif
+}
+
+/*****************************************************************************************
+* Function name	: static void extRAM_Pool_Setup(U8 pool, U32 base, U16 blk_size, U16 blk_count,
+*				  U32 *bitmap, U16 *req_size)
+* Returns		: Nothing.
+* Arguments		: U8 pool ---> Pool index.
+*				  U32 base ---> First RAM address of the pool.
+*				  U16 blk_size, U16 blk_count ---> Pool geometry.
+*				  U32 *bitmap, U16 *req_size ---> Bookkeeping arrays of the pool.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Initialises one pool descriptor with every block free.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+******************************************************************************************/
+static void extRAM_Pool_Setup(U8 pool, U32 base, U16 blk_size, U16 blk_count, U32 *bitmap, U16 *req_size)
+{
+	RAM_POOL *pl = &ram_pools[pool];
+
+	pl->base = base;
+	pl->bitmap = bitmap;
+	pl->req_size = req_size;
+	memset(bitmap, 0, BITMAP_WORDS(blk_count) * sizeof(U32));
+	memset(&pl->st, 0, sizeof(pl->st));
+	pl->st.blk_size = blk_size;
+	pl->st.blk_count = blk_count;
+}
+
+/*****************************************************************************
+* Function name	: extRAM_HANDLE extRAM_Pool_Alloc(U16 size)
+* Returns		: extRAM_HANDLE ---> handle of the block, extRAM_HANDLE_NULL if
+*				  no pool can serve the request.
+* Arguments		: U16 size ---> Number of bytes required.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Takes the first free block of the smallest pool whose block size
+*				  fits. If that pool is full the next bigger pool is tried and the
+*				  spill is counted against the preferred pool.
+*               :
+* Notes			: Free block search walks the bitmap 32 blocks at a time.
+* Global Variables Affected	: NA
+*****************************************************************************/
+extRAM_HANDLE extRAM_Pool_Alloc(U16 size)
+{
+	RAM_POOL *preferred = NULL;
+
+	if (size == 0)
+	{
+		return extRAM_HANDLE_NULL;
+	}
+
+	for (U8 pIdx = 0; pIdx < extRAM_POOL_COUNT; pIdx ++)
+	{
+		RAM_POOL *pl = &ram_pools[pIdx];
+
+		if (pl->st.blk_size < size)
+		{
+			continue;
+		}
+		if (preferred == NULL)
+		{
+			preferred = pl;
+		}
+		if (pl->st.used >= pl->st.blk_count)
+		{
+			continue;
+		}
+
+		for (U16 wIdx = 0; wIdx < BITMAP_WORDS(pl->st.blk_count); wIdx ++)
+		{
+			if (pl->bitmap[wIdx] == 0xFFFFFFFF)
+			{
+				continue;
+			}
+
+			U16 blk = (wIdx * 32) + __builtin_ctz(~pl->bitmap[wIdx]);
+			if (blk >= pl->st.blk_count)
+			{
+				break;
+			}
+
+			pl->bitmap[wIdx] |= (1UL << (blk % 32));
+			pl->req_size[blk] = size;
+			pl->st.used ++;
+			pl->st.waste_bytes += pl->st.blk_size - size;
+			if (pl->st.used > pl->st.high_water)
+			{
+				pl->st.high_water = pl->st.used;
+			}
+			if (pl != preferred)
+			{
+				preferred->st.spill ++;
+			}
+
+			return pl->base + ((U32)blk * pl->st.blk_size);
+		}
+	}
+
+	if (preferred != NULL)
+	{
+		preferred->st.alloc_fail ++;
+	}
+
+	#if extRAM_DEBUG_ALLOC
+	Print_Message("\nextRAM pool allocation failed for size : ");
+	Print_Number(size);
+	#endif
+
+	return extRAM_HANDLE_NULL;
+}
+
+/*****************************************************************************
+* Function name	: U8 extRAM_Pool_Free(extRAM_HANDLE hdl)
+* Returns		: U8 ---> extRAM_OK, extRAM_ERR_HANDLE if the handle is not a
+*				  live pool block.
+* Arguments		: extRAM_HANDLE hdl ---> Handle from extRAM_Pool_Alloc.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Returns a block to its pool.
+*               :
+* Notes			: Double free is detected and rejected.
+* Global Variables Affected	: NA
+*****************************************************************************/
+U8 extRAM_Pool_Free(extRAM_HANDLE hdl)
+{
+	RAM_POOL *pl = extRAM_Find_Pool(hdl);
+
+	if (pl == NULL)
+	{
+		return extRAM_ERR_HANDLE;
+	}
+
+	U16 blk = (hdl - pl->base) / pl->st.blk_size;
+	U32 mask = 1UL << (blk % 32);
+
+	if ((pl->bitmap[blk / 32] & mask) == 0)
+	{
+		#if extRAM_DEBUG_ALLOC
+		Print_Message("\nextRAM block is already free.");
+		#endif
+		return extRAM_ERR_HANDLE;
+	}
+
+	pl->bitmap[blk / 32] &= ~mask;
+	pl->st.used --;
+	pl->st.waste_bytes -= pl->st.blk_size - pl->req_size[blk];
+	pl->req_size[blk] = 0;
+
+	return extRAM_OK;
+}
+
+/*****************************************************************************
+* Function name	: extRAM_HANDLE extRAM_Arena_Alloc(U32 size)
+* Returns		: extRAM_HANDLE ---> handle of the area, extRAM_HANDLE_NULL if
+*				  the arena has no room.
+* Arguments		: U32 size ---> Number of bytes required.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Bump allocation from the arena. Arena memory is not freed one by
+*				  one, use extRAM_Arena_Mark / extRAM_Arena_Release around a session.
+*               :
+* Notes			: Size is rounded up to extRAM_ARENA_ALIGN.
+* Global Variables Affected	: NA
+*****************************************************************************/
+extRAM_HANDLE extRAM_Arena_Alloc(U32 size)
+{
+	size = (size + (extRAM_ARENA_ALIGN - 1)) & ~(U32)(extRAM_ARENA_ALIGN - 1);
+
+	if ((size == 0) || (size > (extRAM_HEAP_END - arena_top)))
+	{
+		arena_st.alloc_fail ++;
+
+		#if extRAM_DEBUG_ALLOC
+		Print_Message("\nextRAM arena allocation failed for size : ");
+		Print_Number(size);
+		#endif
+		return extRAM_HANDLE_NULL;
+	}
+
+	extRAM_HANDLE hdl = arena_top;
+	arena_top += size;
+	arena_st.used = arena_top - arena_base;
+	if (arena_st.used > arena_st.high_water)
+	{
+		arena_st.high_water = arena_st.used;
+	}
+
+	return hdl;
+}
+
+/*****************************************************************************
+* Function name	: U32 extRAM_Arena_Mark(void)
+* Returns		: U32 ---> Current arena position.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Saves the arena position at the start of a session.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+U32 extRAM_Arena_Mark(void)
+{
+	return arena_top;
+}
+
+/*****************************************************************************
+* Function name	: void extRAM_Arena_Release(U32 mark)
+* Returns		: Nothing.
+* Arguments		: U32 mark ---> Value from extRAM_Arena_Mark.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Frees every arena allocation made after the mark was taken.
+*				  extRAM_Arena_Release(0) empties the arena.
+*               :
+* Notes			: Marks above the current position are ignored.
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_Arena_Release(U32 mark)
+{
+	if (mark < arena_base)
+	{
+		mark = arena_base;
+	}
+	if (mark <= arena_top)
+	{
+		arena_top = mark;
+		arena_st.used = arena_top - arena_base;
+	}
+}
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_Handle_Write(extRAM_HANDLE hdl, U32 offset, const U8 *data, U32 len)
+* Returns		: U8 ---> extRAM_OK, extRAM_ERR_HANDLE or extRAM_ERR_LENGTH.
+* Arguments		: extRAM_HANDLE hdl ---> Pool block or arena handle.
+*				  U32 offset ---> Byte offset inside the allocation.
+*				  const U8 *data, U32 len ---> Data to write.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Writes into an allocation through extRAM_Write, refusing to run
+*				  past the end of a pool block or the arena top.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_Handle_Write(extRAM_HANDLE hdl, U32 offset, const U8 *data, U32 len)
+{
+	U32 limit = extRAM_Handle_Limit(hdl);
+
+	if (limit == 0)
+	{
+		return extRAM_ERR_HANDLE;
+	}
+	if ((offset >= limit) || (len > (limit - offset)))
+	{
+		return extRAM_ERR_LENGTH;
+	}
+
+	return extRAM_Write(hdl + offset, data, len);
+}
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_Handle_Read(extRAM_HANDLE hdl, U32 offset, U8 *data, U32 len)
+* Returns		: U8 ---> extRAM_OK, extRAM_ERR_HANDLE or extRAM_ERR_LENGTH.
+* Arguments		: extRAM_HANDLE hdl ---> Pool block or arena handle.
+*				  U32 offset ---> Byte offset inside the allocation.
+*				  U8 *data, U32 len ---> Buffer to read into.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Reads from an allocation through extRAM_Read with the same bounds
+*				  as extRAM_Handle_Write.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_Handle_Read(extRAM_HANDLE hdl, U32 offset, U8 *data, U32 len)
+{
+	U32 limit = extRAM_Handle_Limit(hdl);
+
+	if (limit == 0)
+	{
+		return extRAM_ERR_HANDLE;
+	}
+	if ((offset >= limit) || (len > (limit - offset)))
+	{
+		return extRAM_ERR_LENGTH;
+	}
+
+	return extRAM_Read(hdl + offset, data, len);
+}
+
+/*****************************************************************************
+* Function name	: static RAM_POOL* extRAM_Find_Pool(extRAM_HANDLE hdl)
+* Returns		: RAM_POOL* ---> Pool owning the handle, NULL if none.
+* Arguments		: extRAM_HANDLE hdl ---> Handle to look up.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Maps a handle to its pool by address range and checks that it
+*				  points at the start of a block.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static RAM_POOL* extRAM_Find_Pool(extRAM_HANDLE hdl)
+{
+	for (U8 pIdx = 0; pIdx < extRAM_POOL_COUNT; pIdx ++)
+	{
+		RAM_POOL *pl = &ram_pools[pIdx];
+		U32 pool_size = (U32)pl->st.blk_size * pl->st.blk_count;
+
+		if ((hdl >= pl->base) && ((hdl - pl->base) < pool_size))
+		{
+			return (((hdl - pl->base) % pl->st.blk_size) == 0) ? pl : NULL;
+		}
+	}
+
+	return NULL;
+}
+
+/*****************************************************************************
+* Function name	: static U32 extRAM_Handle_Limit(extRAM_HANDLE hdl)
+* Returns		: U32 ---> Bytes accessible from the handle, 0 if invalid.
+* Arguments		: extRAM_HANDLE hdl ---> Handle to check.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: A live pool block gives its block size, an arena handle gives
+*				  the distance to the arena top.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static U32 extRAM_Handle_Limit(extRAM_HANDLE hdl)
+{
+	RAM_POOL *pl = extRAM_Find_Pool(hdl);
+
+	if (pl != NULL)
+	{
+		U16 blk = (hdl - pl->base) / pl->st.blk_size;
+		return (pl->bitmap[blk / 32] & (1UL << (blk % 32))) ? pl->st.blk_size : 0;
+	}
+	if ((hdl >= arena_base) && (hdl < arena_top))
+	{
+		return arena_top - hdl;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+* Function name	: void extRAM_Get_Pool_Stats(U8 pool, RAM_POOL_STATS *stats)
+* Returns		: Nothing.
+* Arguments		: U8 pool ---> Pool index, 0 to extRAM_POOL_COUNT - 1.
+*				  RAM_POOL_STATS *stats ---> Filled with a copy of the statistics.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Gives usage, high-water and fragmentation counters of a pool.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_Get_Pool_Stats(U8 pool, RAM_POOL_STATS *stats)
+{
+	if (pool < extRAM_POOL_COUNT)
+	{
+		*stats = ram_pools[pool].st;
+	}
+}
+
+/*****************************************************************************
+* Function name	: void extRAM_Get_Arena_Stats(RAM_ARENA_STATS *stats)
+* Returns		: Nothing.
+* Arguments		: RAM_ARENA_STATS *stats ---> Filled with a copy of the statistics.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Gives usage and high-water counters of the arena.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_Get_Arena_Stats(RAM_ARENA_STATS *stats)
+{
+	*stats = arena_st;
+}
+
+/*****************************************************************************
+* Function name	: void extRAM_Print_Alloc_Stats(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Prints pool and arena statistics on the debug UART.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_Print_Alloc_Stats(void)
+{
+	for (U8 pIdx = 0; pIdx < extRAM_POOL_COUNT; pIdx ++)
+	{
+		RAM_POOL_STATS *st = &ram_pools[pIdx].st;
+
+		Print_Message("\nPool ");
+		Print_Number(pIdx);
+		Print_Message(" | Block : ");
+		Print_Number(st->blk_size);
+		Print_Message(" | Used : ");
+		Print_Number(st->used);
+		Print_Message("/");
+		Print_Number(st->blk_count);
+		Print_Message(" | High : ");
+		Print_Number(st->high_water);
+		Print_Message(" | Fail : ");
+		Print_Number(st->alloc_fail);
+		Print_Message(" | Spill : ");
+		Print_Number(st->spill);
+		Print_Message(" | Waste : ");
+		Print_Number(st->waste_bytes);
+	}
+
+	Print_Message("\nArena | Used : ");
+	Print_Number(arena_st.used);
+	Print_Message("/");
+	Print_Number(arena_st.size);
+	Print_Message(" | High : ");
+	Print_Number(arena_st.high_water);
+	Print_Message(" | Fail : ");
+	Print_Number(arena_st.alloc_fail);
+}
@@ -0,0 +1,109 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_alloc.h
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Header file for ext_ram_alloc.c
+*				  Defines the pool and arena layout of the external RAM.
+*
+*****************************************************************************/
+#ifndef EXT_RAM_ALLOC_H_
+#define EXT_RAM_ALLOC_H_
+
+#include "asf.h"
+#include "ext_ram.h"
+#include "ext_ram_ckpt.h"
+
+/***** MACROS / DEFINITIONS FOR THE ALLOCATOR *****/
+#ifndef extRAM_HEAP_BASE
+#define extRAM_HEAP_BASE		0x000000				// First address managed by the allocator.
+#endif
+
+#ifndef extRAM_HEAP_END
+#define extRAM_HEAP_END			extRAM_CKPT_BASE		// One past the last managed address, checkpoint slots above.
+#endif
+
+/* Fixed size pools, smallest block size first. */
+#ifndef extRAM_POOL0_BLK_SIZE
+#define extRAM_POOL0_BLK_SIZE	32
+#endif
+#ifndef extRAM_POOL0_BLK_COUNT
+#define extRAM_POOL0_BLK_COUNT	512
+#endif
+
+#ifndef extRAM_POOL1_BLK_SIZE
+#define extRAM_POOL1_BLK_SIZE	128
+#endif
+#ifndef extRAM_POOL1_BLK_COUNT
+#define extRAM_POOL1_BLK_COUNT	256
+#endif
+
+#ifndef extRAM_POOL2_BLK_SIZE
+#define extRAM_POOL2_BLK_SIZE	512
+#endif
+#ifndef extRAM_POOL2_BLK_COUNT
+#define extRAM_POOL2_BLK_COUNT	128
+#endif
+
+#ifndef extRAM_POOL3_BLK_SIZE
+#define extRAM_POOL3_BLK_SIZE	2048
+#endif
+#ifndef extRAM_POOL3_BLK_COUNT
+#define extRAM_POOL3_BLK_COUNT	32
+#endif
+
+#define extRAM_POOL_COUNT		4
+#define extRAM_ARENA_ALIGN		4						// Arena allocations are rounded up to this.
+
+#define extRAM_POOLS_BYTE_SIZE	((extRAM_POOL0_BLK_SIZE * extRAM_POOL0_BLK_COUNT) + \
+								(extRAM_POOL1_BLK_SIZE * extRAM_POOL1_BLK_COUNT) + \
+								(extRAM_POOL2_BLK_SIZE * extRAM_POOL2_BLK_COUNT) + \
+								(extRAM_POOL3_BLK_SIZE * extRAM_POOL3_BLK_COUNT))
+
+#if (extRAM_POOLS_BYTE_SIZE > (extRAM_HEAP_END - extRAM_HEAP_BASE))
+#error "extRAM pools do not fit between extRAM_HEAP_BASE and extRAM_HEAP_END"
+#endif
+
+/***** DEBUG MESSAGES *****/
+#define extRAM_DEBUG_ALLOC		(0)
+/***** END OF DEBUG MESSAGES *****/
+
+/***** Handle *****/
+/* Opaque to the user, internally it is the RAM address of the block. */
+typedef U32 extRAM_HANDLE;
+#define extRAM_HANDLE_NULL		(0xFFFFFFFF)
+
+/***** Structure Declarations *****/
+typedef struct
+{
+	U16 blk_size;		// Bytes per block.
+	U16 blk_count;		// Blocks in the pool.
+	U16 used;			// Blocks currently allocated.
+	U16 high_water;		// Maximum of used since init.
+	U16 alloc_fail;		// Requests that found every fitting pool full.
+	U16 spill;			// Requests served by a bigger pool because this one was full.
+	U32 waste_bytes;	// Internal fragmentation: allocated minus requested bytes of live blocks.
+}RAM_POOL_STATS;
+
+typedef struct
+{
+	U32 size;			// Bytes available to the arena.
+	U32 used;			// Bytes currently allocated.
+	U32 high_water;		// Maximum of used since init.
+	U16 alloc_fail;		// Requests that did not fit.
+}RAM_ARENA_STATS;
+
+/***** Function Prototypes *****/
+void extRAM_Alloc_Init(void);
+extRAM_HANDLE extRAM_Pool_Alloc(U16 size);
+U8 extRAM_Pool_Free(extRAM_HANDLE hdl);
+extRAM_HANDLE extRAM_Arena_Alloc(U32 size);
+U32 extRAM_Arena_Mark(void);
+void extRAM_Arena_Release(U32 mark);
+U8 extRAM_Handle_Write(extRAM_HANDLE hdl, U32 offset, const U8 *data, U32 len);
+U8 extRAM_Handle_Read(extRAM_HANDLE hdl, U32 offset, U8 *data, U32 len);
+void extRAM_Get_Pool_Stats(U8 pool, RAM_POOL_STATS *stats);
+void extRAM_Get_Arena_Stats(RAM_ARENA_STATS *stats);
+void extRAM_Print_Alloc_Stats(void);
+#endif /* EXT_RAM_ALLOC_H_ */
@@ -0,0 +1,345 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_cache.c
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Set-associative write-back cache of external RAM pages in
+*				  internal RAM. Reads of a cached line cost no SPI transaction,
+*				  writes only mark the line dirty. Dirty lines go back to the
+*				  external RAM when they are evicted or at an explicit flush,
+*				  where runs of adjacent dirty lines are merged into one burst.
+*
+*				  Data accessed through the cache must not be accessed with
+*				  extRAM_Write / extRAM_Read directly, or it must be flushed /
+*				  invalidated around such accesses.
+*
+* Controller	: 	ATSAM4E16CA-AUR
+*					1024 KB		Flash.
+*					128 KB		RAM.
+*
+*****************************************************************************/
+
+#include "ext_ram_cache.h"
+#include "string.h"
+#include "user_uart.h"
+
+#define CACHE_LINE_COUNT	(extRAM_CACHE_SETS * extRAM_CACHE_WAYS)
+
+typedef struct
+{
+	U32 line_no;						// RAM address / extRAM_CACHE_LINE_SIZE.
+	U32 stamp;							// Access time, the oldest line of a set is the victim.
+	U8 valid;
+	U8 dirty;
+	U8 data[extRAM_CACHE_LINE_SIZE];
+}RAM_CACHE_LINE;
+
+/***** Local variables *****/
+static RAM_CACHE_LINE cache_lines[extRAM_CACHE_SETS][extRAM_CACHE_WAYS];
+static U32 cache_clock = 0;			// Incremented on every line access.
+static RAM_CACHE_STATS cache_st;
+
+static RAM_CACHE_LINE* extRAM_Cache_Find(U32 line_no);
+static RAM_CACHE_LINE* extRAM_Cache_Get_Line(U32 line_no, U8 fill);
+static void extRAM_Cache_Write_Back(RAM_CACHE_LINE *line);
+
+/*****************************************************************************
+* Function name	: void extRAM_Cache_Init(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Marks every line invalid and clears the statistics.
+*               :
+* Notes			: Dirty data is lost, use extRAM_Cache_Invalidate to keep it.
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_Cache_Init(void)
+{
+	memset(cache_lines, 0, sizeof(cache_lines));
+	memset(&cache_st, 0, sizeof(cache_st));
+	cache_clock = 0;
+}
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_Cache_Read(U32 adds, U8 *data, U32 len)
+* Returns		: U8 ---> extRAM_OK, else extRAM_ERR_ADDRESS / extRAM_ERR_LENGTH.
+* Arguments		: U32 adds ---> Start address inside the external RAM.
+*				  U8 *data ---> Buffer to read into.
+*				  U32 len ---> Number of bytes to read.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Copies from cached lines, missing lines are filled with one
+*				  page burst each.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_Cache_Read(U32 adds, U8 *data, U32 len)
+{
+	U8 sts = extRAM_Check_Range(adds, len);
+	if (sts != extRAM_OK)
+	{
+		return sts;
+	}
+
+	while (len > 0)
+	{
+		U32 offset = adds % extRAM_CACHE_LINE_SIZE;
+		U32 copy_len = extRAM_CACHE_LINE_SIZE - offset;
+		RAM_CACHE_LINE *line = extRAM_Cache_Get_Line(adds / extRAM_CACHE_LINE_SIZE, 1);
+
+		if (copy_len > len)
+		{
+			copy_len = len;
+		}
+		memcpy(data, &line->data[offset], copy_len);
+
+		adds += copy_len;
+		data += copy_len;
+		len -= copy_len;
+	}
+
+	return extRAM_OK;
+}
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_Cache_Write(U32 adds, const U8 *data, U32 len)
+* Returns		: U8 ---> extRAM_OK, else extRAM_ERR_ADDRESS / extRAM_ERR_LENGTH.
+* Arguments		: U32 adds ---> Start address inside the external RAM.
+*				  const U8 *data ---> Data to write.
+*				  U32 len ---> Number of bytes to write.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Copies into cached lines and marks them dirty. A line that is
+*				  completely overwritten is not filled first.
+*               :
+* Notes			: The external RAM is updated on eviction or extRAM_Cache_Flush.
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_Cache_Write(U32 adds, const U8 *data, U32 len)
+{
+	U8 sts = extRAM_Check_Range(adds, len);
+	if (sts != extRAM_OK)
+	{
+		return sts;
+	}
+
+	while (len > 0)
+	{
+		U32 offset = adds % extRAM_CACHE_LINE_SIZE;
+		U32 copy_len = extRAM_CACHE_LINE_SIZE - offset;
+
+		if (copy_len > len)
+		{
+			copy_len = len;
+		}
+
+		RAM_CACHE_LINE *line = extRAM_Cache_Get_Line(adds / extRAM_CACHE_LINE_SIZE, (copy_len != extRAM_CACHE_LINE_SIZE));
+		memcpy(&line->data[offset], data, copy_len);
+		line->dirty = 1;
+
+		adds += copy_len;
+		data += copy_len;
+		len -= copy_len;
+	}
+
+	return extRAM_OK;
+}
+
+/*****************************************************************************
+* Function name	: void extRAM_Cache_Flush(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Writes every dirty line back. Lines stay valid.
+*               :
+* Notes			: Call at the application flush points (before sleep, before
+*				  the RAM is handed to a PDC transfer, etc.).
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_Cache_Flush(void)
+{
+	for (U8 sIdx = 0; sIdx < extRAM_CACHE_SETS; sIdx ++)
+	{
+		for (U8 wIdx = 0; wIdx < extRAM_CACHE_WAYS; wIdx ++)
+		{
+			if (cache_lines[sIdx][wIdx].valid && cache_lines[sIdx][wIdx].dirty)
+			{
+				extRAM_Cache_Write_Back(&cache_lines[sIdx][wIdx]);
+			}
+		}
+	}
+}
+
+/*****************************************************************************
+* Function name	: void extRAM_Cache_Invalidate(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Flushes and then drops every line, so following reads come
+*				  from the external RAM again.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_Cache_Invalidate(void)
+{
+	extRAM_Cache_Flush();
+
+	for (U8 sIdx = 0; sIdx < extRAM_CACHE_SETS; sIdx ++)
+	{
+		for (U8 wIdx = 0; wIdx < extRAM_CACHE_WAYS; wIdx ++)
+		{
+			cache_lines[sIdx][wIdx].valid = 0;
+		}
+	}
+}
+
+/*****************************************************************************
+* Function name	: void extRAM_Get_Cache_Stats(RAM_CACHE_STATS *stats)
+* Returns		: Nothing.
+* Arguments		: RAM_CACHE_STATS *stats ---> Filled with a copy of the statistics.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Gives hit / miss and write-back counters.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_Get_Cache_Stats(RAM_CACHE_STATS *stats)
+{
+	*stats = cache_st;
+}
+
+/*****************************************************************************
+* Function name	: static RAM_CACHE_LINE* extRAM_Cache_Find(U32 line_no)
+* Returns		: RAM_CACHE_LINE* ---> Cached line, NULL if not cached.
+* Arguments		: U32 line_no ---> RAM address / extRAM_CACHE_LINE_SIZE.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Looks the line up in its set.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static RAM_CACHE_LINE* extRAM_Cache_Find(U32 line_no)
+{
+	RAM_CACHE_LINE *set = cache_lines[line_no % extRAM_CACHE_SETS];
+
+	for (U8 wIdx = 0; wIdx < extRAM_CACHE_WAYS; wIdx ++)
+	{
+		if (set[wIdx].valid && (set[wIdx].line_no == line_no))
+		{
+			return &set[wIdx];
+		}
+	}
+
+	return NULL;
+}
+
+/*****************************************************************************
+* Function name	: static RAM_CACHE_LINE* extRAM_Cache_Get_Line(U32 line_no, U8 fill)
+* Returns		: RAM_CACHE_LINE* ---> Line holding line_no.
+* Arguments		: U32 line_no ---> RAM address / extRAM_CACHE_LINE_SIZE.
+*				  U8 fill ---> 1 to read the line from the RAM on a miss.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: On a miss the least recently used way of the set is evicted
+*				  (written back if dirty) and reused.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static RAM_CACHE_LINE* extRAM_Cache_Get_Line(U32 line_no, U8 fill)
+{
+	RAM_CACHE_LINE *line = extRAM_Cache_Find(line_no);
+
+	cache_clock ++;
+	if (line != NULL)
+	{
+		cache_st.hits ++;
+		line->stamp = cache_clock;
+		return line;
+	}
+
+	cache_st.misses ++;
+
+	RAM_CACHE_LINE *set = cache_lines[line_no % extRAM_CACHE_SETS];
+	line = &set[0];
+	for (U8 wIdx = 0; wIdx < extRAM_CACHE_WAYS; wIdx ++)
+	{
+		if (!set[wIdx].valid)
+		{
+			line = &set[wIdx];
+			break;
+		}
+		if (set[wIdx].stamp < line->stamp)
+		{
+			line = &set[wIdx];
+		}
+	}
+
+	if (line->valid && line->dirty)
+	{
+		extRAM_Cache_Write_Back(line);
+	}
+
+	line->line_no = line_no;
+	line->valid = 1;
+	line->dirty = 0;
+	line->stamp = cache_clock;
+	if (fill)
+	{
+		extRAM_Read(line_no * extRAM_CACHE_LINE_SIZE, line->data, extRAM_CACHE_LINE_SIZE);
+		cache_st.fills ++;
+	}
+
+	return line;
+}
+
+/*****************************************************************************
+* Function name	: static void extRAM_Cache_Write_Back(RAM_CACHE_LINE *line)
+* Returns		: Nothing.
+* Arguments		: RAM_CACHE_LINE *line ---> Dirty line to write back.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Extends the line to the run of cached dirty lines with
+*				  consecutive addresses around it and writes the whole run with
+*				  one extRAM_Write_SG, i.e. one command and one chip select.
+*               :
+* Notes			: Every line of the run is marked clean.
+* Global Variables Affected	: NA
+*****************************************************************************/
+static void extRAM_Cache_Write_Back(RAM_CACHE_LINE *line)
+{
+	RAM_SEG seg[CACHE_LINE_COUNT];
+	RAM_CACHE_LINE *run_line;
+	U32 first_no = line->line_no;
+	U8 seg_cnt = 0;
+
+	/* Walk back to the start of the dirty run */
+	while (first_no > 0)
+	{
+		run_line = extRAM_Cache_Find(first_no - 1);
+		if ((run_line == NULL) || (!run_line->dirty))
+		{
+			break;
+		}
+		first_no --;
+	}
+
+	/* Collect the run forward */
+	run_line = extRAM_Cache_Find(first_no);
+	while ((run_line != NULL) && run_line->dirty && (seg_cnt < CACHE_LINE_COUNT))
+	{
+		seg[seg_cnt].data = run_line->data;
+		seg[seg_cnt].len = extRAM_CACHE_LINE_SIZE;
+		seg_cnt ++;
+		run_line->dirty = 0;
+		run_line = extRAM_Cache_Find(first_no + seg_cnt);
+	}
+
+	extRAM_Write_SG(first_no * extRAM_CACHE_LINE_SIZE, seg, seg_cnt);
+	cache_st.write_backs += seg_cnt;
+	cache_st.bursts ++;
+
+	#if extRAM_DEBUG_CACHE
+	Print_Message("\nextRAM cache write-back, lines : ");
+	Print_Number(seg_cnt);
+	#endif
+}
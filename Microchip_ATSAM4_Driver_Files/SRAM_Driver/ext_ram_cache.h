@@ -0,0 +1,50 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_cache.h
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Header file for ext_ram_cache.c
+*				  Defines the geometry of the internal RAM cache in front of
+*				  the external RAM.
+*
+*****************************************************************************/
+#ifndef EXT_RAM_CACHE_H_
+#define EXT_RAM_CACHE_H_
+
+#include "asf.h"
+#include "ext_ram.h"
+
+/***** MACROS / DEFINITIONS FOR THE CACHE *****/
+#ifndef extRAM_CACHE_SETS
+#define extRAM_CACHE_SETS		16					// Number of sets.
+#endif
+
+#ifndef extRAM_CACHE_WAYS
+#define extRAM_CACHE_WAYS		2					// Lines per set.
+#endif
+
+#define extRAM_CACHE_LINE_SIZE	extRAM_PAGE_SIZE	// A line is one RAM page, so a line burst never wraps.
+
+/***** DEBUG MESSAGES *****/
+#define extRAM_DEBUG_CACHE		(0)
+/***** END OF DEBUG MESSAGES *****/
+
+/***** Structure Declarations *****/
+typedef struct
+{
+	U32 hits;			// Line accesses served from internal RAM.
+	U32 misses;			// Line accesses that needed a victim.
+	U32 fills;			// Lines read from the external RAM.
+	U32 write_backs;	// Dirty lines written to the external RAM.
+	U32 bursts;			// SPI write bursts used for the write-backs.
+}RAM_CACHE_STATS;
+
+/***** Function Prototypes *****/
+void extRAM_Cache_Init(void);
+U8 extRAM_Cache_Read(U32 adds, U8 *data, U32 len);
+U8 extRAM_Cache_Write(U32 adds, const U8 *data, U32 len);
+void extRAM_Cache_Flush(void);
+void extRAM_Cache_Invalidate(void);
+void extRAM_Get_Cache_Stats(RAM_CACHE_STATS *stats);
+#endif /* EXT_RAM_CACHE_H_ */
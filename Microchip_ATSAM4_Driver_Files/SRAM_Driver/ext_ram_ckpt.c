@@ -0,0 +1,290 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_ckpt.c
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Checkpoint region in the external RAM that survives a
+*				  watchdog / software reset (the RAM is not cleared by a reset
+*				  of the controller, and keeps its data over power loss when
+*				  battery backed).
+*
+*				  Two slots are written alternately. The data of a save goes to
+*				  the older slot first and its header last, so a reset in the
+*				  middle of a save leaves the previous checkpoint valid. At boot
+*				  extRAM_Ckpt_Init checks magic and CRC-32 of both slots and
+*				  keeps the newest valid one for extRAM_Ckpt_Restore.
+*
+* Controller	: 	ATSAM4E16CA-AUR
+*					1024 KB		Flash.
+*					128 KB		RAM.
+*
+*****************************************************************************/
+
+#include "ext_ram_ckpt.h"
+#include "string.h"
+#include "user_uart.h"
+
+#define CKPT_NO_SLOT		0xFF
+#define CKPT_CHUNK_SIZE		64		// Bytes read at a time while checking the data CRC.
+
+/***** Local variables *****/
+static RAM_CKPT_HDR ckpt_hdr;					// Header of the newest valid slot.
+static U8 ckpt_slot = CKPT_NO_SLOT;				// Slot holding ckpt_hdr.
+static U32 ckpt_seq = 0;						// Last sequence number seen or written.
+static U32 ckpt_reset_cause = 0;
+
+static const U32 crc32_nibble_table[16] =
+{
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static U32 Ckpt_CRC32(U32 crc, const U8 *data, U32 len);
+static U32 Ckpt_Slot_Adds(U8 slot);
+static U8 Ckpt_Validate_Slot(U8 slot, RAM_CKPT_HDR *hdr);
+
+/*****************************************************************************
+* Function name	: U8 extRAM_Ckpt_Init(void)
+* Returns		: U8 ---> extRAM_OK if a valid checkpoint was found, else
+*				  extRAM_ERR_EMPTY (cold start).
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Latches the reset cause and validates both slots.
+*               :
+* Notes			: Call once at boot, after the SPI and before any RAM test
+*				  (ext_ram_test.c erases the whole device).
+* Global Variables Affected	: NA
+*****************************************************************************/
+U8 extRAM_Ckpt_Init(void)
+{
+	RAM_CKPT_HDR hdr;
+
+	ckpt_reset_cause = rstc_get_reset_cause(RSTC);
+	ckpt_slot = CKPT_NO_SLOT;
+
+	for (U8 slot = 0; slot < extRAM_CKPT_SLOT_COUNT; slot ++)
+	{
+		if (Ckpt_Validate_Slot(slot, &hdr) != extRAM_OK)
+		{
+			continue;
+		}
+		if ((ckpt_slot == CKPT_NO_SLOT) || ((int32_t)(hdr.seq - ckpt_hdr.seq) > 0))
+		{
+			ckpt_slot = slot;
+			ckpt_hdr = hdr;
+		}
+	}
+
+	if (ckpt_slot != CKPT_NO_SLOT)
+	{
+		ckpt_seq = ckpt_hdr.seq;
+	}
+
+	#if extRAM_DEBUG_CKPT
+	Print_Message("\nextRAM checkpoint, reset cause : ");
+	Print_Number(ckpt_reset_cause >> RSTC_SR_RSTTYP_Pos);
+	if (ckpt_slot == CKPT_NO_SLOT)
+	{
+		Print_Message(" no valid slot, cold start");
+	}
+	else
+	{
+		Print_Message(" slot : ");
+		Print_Number(ckpt_slot);
+		Print_Message(" seq : ");
+		Print_Number(ckpt_hdr.seq);
+		Print_Message(" len : ");
+		Print_Number(ckpt_hdr.len);
+	}
+	#endif
+
+	return (ckpt_slot == CKPT_NO_SLOT) ? extRAM_ERR_EMPTY : extRAM_OK;
+}
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_Ckpt_Save(const U8 *data, U32 len)
+* Returns		: U8 ---> extRAM_OK, else extRAM_ERR_LENGTH.
+* Arguments		: const U8 *data ---> Application state to keep.
+*				  U32 len ---> Bytes of state, 1 to extRAM_CKPT_MX_DATA.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Writes the state to the slot not holding the current
+*				  checkpoint, data first and header last, and makes it current.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_Ckpt_Save(const U8 *data, U32 len)
+{
+	RAM_CKPT_HDR hdr;
+	U8 slot = (ckpt_slot == 0) ? 1 : 0;
+
+	if ((len == 0) || (len > extRAM_CKPT_MX_DATA))
+	{
+		return extRAM_ERR_LENGTH;
+	}
+
+	hdr.magic = extRAM_CKPT_MAGIC;
+	hdr.seq = ckpt_seq + 1;
+	hdr.len = len;
+	hdr.data_crc = Ckpt_CRC32(0xFFFFFFFF, data, len) ^ 0xFFFFFFFF;
+	hdr.hdr_crc = Ckpt_CRC32(0xFFFFFFFF, (const U8 *)&hdr, extRAM_CKPT_HDR_SIZE - 4) ^ 0xFFFFFFFF;
+
+	extRAM_Write(Ckpt_Slot_Adds(slot) + extRAM_CKPT_HDR_SIZE, data, len);
+	extRAM_Write(Ckpt_Slot_Adds(slot), (const U8 *)&hdr, extRAM_CKPT_HDR_SIZE);
+
+	ckpt_seq = hdr.seq;
+	ckpt_hdr = hdr;
+	ckpt_slot = slot;
+
+	return extRAM_OK;
+}
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_Ckpt_Restore(U8 *data, U32 max_len, U32 *len)
+* Returns		: U8 ---> extRAM_OK, extRAM_ERR_EMPTY if there is no checkpoint,
+*				  extRAM_ERR_LENGTH if it does not fit in the buffer.
+* Arguments		: U8 *data ---> Buffer for the state.
+*				  U32 max_len ---> Size of the buffer.
+*				  U32 *len ---> Returns the bytes restored.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Hands back the checkpoint found by extRAM_Ckpt_Init or written
+*				  by the last extRAM_Ckpt_Save.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_Ckpt_Restore(U8 *data, U32 max_len, U32 *len)
+{
+	*len = 0;
+
+	if (ckpt_slot == CKPT_NO_SLOT)
+	{
+		return extRAM_ERR_EMPTY;
+	}
+	if (ckpt_hdr.len > max_len)
+	{
+		return extRAM_ERR_LENGTH;
+	}
+
+	extRAM_Read(Ckpt_Slot_Adds(ckpt_slot) + extRAM_CKPT_HDR_SIZE, data, ckpt_hdr.len);
+	*len = ckpt_hdr.len;
+
+	return extRAM_OK;
+}
+
+/*****************************************************************************
+* Function name	: void extRAM_Ckpt_Invalidate(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Clears the magic of both slots so the next boot is a cold
+*				  start (e.g. after a configuration change).
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_Ckpt_Invalidate(void)
+{
+	U32 magic = 0;
+
+	for (U8 slot = 0; slot < extRAM_CKPT_SLOT_COUNT; slot ++)
+	{
+		extRAM_Write(Ckpt_Slot_Adds(slot), (const U8 *)&magic, sizeof(magic));
+	}
+	ckpt_slot = CKPT_NO_SLOT;
+}
+
+/*****************************************************************************
+* Function name	: U32 extRAM_Ckpt_Get_Reset_Cause(void)
+* Returns		: U32 ---> RSTC_SR_RSTTYP field latched by extRAM_Ckpt_Init
+*				  (RSTC_GENERAL_RESET, RSTC_WATCHDOG_RESET, ...).
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Lets the application decide between warm and cold restart.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+U32 extRAM_Ckpt_Get_Reset_Cause(void)
+{
+	return ckpt_reset_cause;
+}
+
+/*****************************************************************************
+* Function name	: static U32 Ckpt_CRC32(U32 crc, const U8 *data, U32 len)
+* Returns		: U32 ---> Updated CRC.
+* Arguments		: U32 crc ---> Running CRC, 0xFFFFFFFF for the first block.
+*				  const U8 *data ---> Data to add.
+*				  U32 len ---> Number of bytes.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: CRC-32 (IEEE, reflected) with a 16 entry table.
+*               :
+* Notes			: The caller inverts the final value.
+* Global Variables Affected	: NA
+*****************************************************************************/
+static U32 Ckpt_CRC32(U32 crc, const U8 *data, U32 len)
+{
+	while (len --)
+	{
+		crc ^= *data ++;
+		crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+		crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+	}
+
+	return crc;
+}
+
+/*****************************************************************************
+* Function name	: static U32 Ckpt_Slot_Adds(U8 slot)
+* Returns		: U32 ---> RAM address of the slot header.
+* Arguments		: U8 slot ---> 0 or 1.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: NA
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static U32 Ckpt_Slot_Adds(U8 slot)
+{
+	return extRAM_CKPT_BASE + ((U32)slot * extRAM_CKPT_SLOT_SIZE);
+}
+
+/*****************************************************************************
+* Function name	: static U8 Ckpt_Validate_Slot(U8 slot, RAM_CKPT_HDR *hdr)
+* Returns		: U8 ---> extRAM_OK if magic, header CRC and data CRC match,
+*				  else extRAM_ERR_EMPTY.
+* Arguments		: U8 slot ---> Slot to check.
+*				  RAM_CKPT_HDR *hdr ---> Returns the slot header.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Reads the header and runs the CRC over the data in chunks.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static U8 Ckpt_Validate_Slot(U8 slot, RAM_CKPT_HDR *hdr)
+{
+	U8 chunk[CKPT_CHUNK_SIZE];
+	U32 adds = Ckpt_Slot_Adds(slot);
+	U32 crc = 0xFFFFFFFF;
+
+	extRAM_Read(adds, (U8 *)hdr, extRAM_CKPT_HDR_SIZE);
+
+	if ((hdr->magic != extRAM_CKPT_MAGIC) ||
+		(hdr->hdr_crc != (Ckpt_CRC32(0xFFFFFFFF, (const U8 *)hdr, extRAM_CKPT_HDR_SIZE - 4) ^ 0xFFFFFFFF)) ||
+		(hdr->len == 0) || (hdr->len > extRAM_CKPT_MX_DATA))
+	{
+		return extRAM_ERR_EMPTY;
+	}
+
+	adds += extRAM_CKPT_HDR_SIZE;
+	for (U32 off = 0; off < hdr->len; off += CKPT_CHUNK_SIZE)
+	{
+		U32 n = ((hdr->len - off) < CKPT_CHUNK_SIZE) ? (hdr->len - off) : CKPT_CHUNK_SIZE;
+
+		extRAM_Read(adds + off, chunk, n);
+		crc = Ckpt_CRC32(crc, chunk, n);
+	}
+
+	return ((crc ^ 0xFFFFFFFF) == hdr->data_crc) ? extRAM_OK : extRAM_ERR_EMPTY;
+}
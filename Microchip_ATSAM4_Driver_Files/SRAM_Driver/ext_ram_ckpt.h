@@ -0,0 +1,49 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_ckpt.h
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Header file for ext_ram_ckpt.c
+*				  Defines the checkpoint slots kept at the top of the external
+*				  RAM for a warm restart after a reset.
+*
+*****************************************************************************/
+#ifndef EXT_RAM_CKPT_H_
+#define EXT_RAM_CKPT_H_
+
+#include "asf.h"
+#include "ext_ram.h"
+
+/***** MACROS / DEFINITIONS FOR THE CHECKPOINT *****/
+#ifndef extRAM_CKPT_SLOT_SIZE
+#define extRAM_CKPT_SLOT_SIZE	4096		// Bytes per slot, header included.
+#endif
+
+#define extRAM_CKPT_SLOT_COUNT	2			// Slot A and slot B are written alternately.
+#define extRAM_CKPT_BASE		(extRAM_MX_BYTE_SIZE - (extRAM_CKPT_SLOT_COUNT * extRAM_CKPT_SLOT_SIZE))
+#define extRAM_CKPT_MAGIC		0x434B5054	// "CKPT"
+#define extRAM_CKPT_HDR_SIZE	20			// sizeof(RAM_CKPT_HDR)
+#define extRAM_CKPT_MX_DATA		(extRAM_CKPT_SLOT_SIZE - extRAM_CKPT_HDR_SIZE)
+
+/***** DEBUG MESSAGES *****/
+#define extRAM_DEBUG_CKPT		(0)
+/***** END OF DEBUG MESSAGES *****/
+
+/***** Structure Declarations *****/
+typedef struct
+{
+	U32 magic;			// extRAM_CKPT_MAGIC.
+	U32 seq;			// Incremented on every save, the higher valid slot wins.
+	U32 len;			// Bytes of application data after the header.
+	U32 data_crc;		// CRC-32 of the data.
+	U32 hdr_crc;		// CRC-32 of the four fields above.
+}RAM_CKPT_HDR;
+
+/***** Function Prototypes *****/
+U8 extRAM_Ckpt_Init(void);
+U8 extRAM_Ckpt_Save(const U8 *data, U32 len);
+U8 extRAM_Ckpt_Restore(U8 *data, U32 max_len, U32 *len);
+void extRAM_Ckpt_Invalidate(void);
+U32 extRAM_Ckpt_Get_Reset_Cause(void);
+#endif /* EXT_RAM_CKPT_H_ */
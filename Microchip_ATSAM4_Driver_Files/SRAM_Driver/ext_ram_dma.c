@@ -0,0 +1,354 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_dma.c
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Non-blocking external RAM transfers using the SPI PDC.
+*				  Requests are queued, the command bytes are sent by the CPU and
+*				  the data phase is moved by the PDC while the main loop runs.
+*				  A callback is invoked from SPI_Handler when a request completes
+*				  and the next queued request is started from there after it.
+*				  Callbacks may queue further requests but must not use the
+*				  blocking extRAM_xxx calls or extRAM_DMA_Wait.
+*				  Requests queued while a blocking transfer owns the bus
+*				  (gb_extRAM_cpu_owner_f) wait till ext_ram.c releases it.
+*
+* Controller	: 	ATSAM4E16CA-AUR
+*					1024 KB		Flash.
+*					128 KB		RAM.
+*
+*****************************************************************************/
+
+#include "ext_ram_dma.h"
+#include "user_uart.h"
+
+/***** Local variables *****/
+static RAM_DMA_REQ dma_queue[extRAM_DMA_QUEUE_LEN];	// Waiting requests, dma_queue[dma_head] is on the bus.
+static volatile uint8_t dma_head = 0;				// Index of the active request.
+static volatile uint8_t dma_count = 0;				// Number of requests in the queue (active included).
+static volatile uint8_t dma_active = 0;				// Flag sets while dma_queue[dma_head] is on the bus.
+static volatile uint8_t dma_in_cb = 0;				// Flag sets while a completion callback runs.
+static uint8_t dma_cmd_data[4] = {0};				// Command and address of the active request.
+static uint8_t *dma_cur_ptr;						// Caller memory of the next PDC chunk.
+static uint32_t dma_remaining = 0;					// Bytes not yet handed to the PDC.
+static Pdc *dma_pdc;								// PDC base of the SPI.
+
+static uint8_t extRAM_DMA_Queue(uint32_t adds, uint8_t *data, uint32_t len, uint8_t dir, extRAM_DMA_CB cb);
+static void extRAM_DMA_Start(void);
+static void extRAM_DMA_Load_Chunk(void);
+static void extRAM_DMA_Finish(void);
+
+/*****************************************************************************
+* Function name	: void extRAM_DMA_Init(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Gets the SPI PDC base and enables the SPI interrupt used to
+*				  detect the end of a PDC transfer.
+*               :
+* Notes			: Call after configure_spi_master() and Configure_CS_Pin_For_extRAM().
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_DMA_Init(void)
+{
+	dma_pdc = spi_get_pdc_base(SPI);
+	pdc_disable_transfer(dma_pdc, PERIPH_PTCR_RXTDIS | PERIPH_PTCR_TXTDIS);
+
+	dma_head = 0;
+	dma_count = 0;
+	dma_active = 0;
+	dma_in_cb = 0;
+	gb_extRAM_dma_busy_f = 0;
+
+	NVIC_DisableIRQ(SPI_IRQn);
+	NVIC_ClearPendingIRQ(SPI_IRQn);
+	NVIC_SetPriority(SPI_IRQn, extRAM_DMA_IRQ_PRIORITY);
+	NVIC_EnableIRQ(SPI_IRQn);
+}
+
+/*****************************************************************************************
+* Function name	: uint8_t extRAM_DMA_Write(uint32_t adds, uint8_t *data, uint32_t len,
+*				  extRAM_DMA_CB cb)
+* Returns		: uint8_t ---> extRAM_OK if queued, else an extRAM_ERR_xxx code.
+* Arguments		: uint32_t adds ---> Start address inside the external RAM.
+*				  uint8_t *data ---> Caller buffer holding the data to write.
+*				  uint32_t len ---> Number of bytes to write.
+*				  extRAM_DMA_CB cb ---> Called on completion, may be NULL.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Queues a write and returns immediately.
+*               :
+* Notes			: The buffer must not be modified until the callback is called.
+* Global Variables Affected	: NA
+******************************************************************************************/
+uint8_t extRAM_DMA_Write(uint32_t adds, uint8_t *data, uint32_t len, extRAM_DMA_CB cb)
+{
+	return extRAM_DMA_Queue(adds, data, len, extRAM_DMA_DIR_WRITE, cb);
+}
+
+/*****************************************************************************************
+* Function name	: uint8_t extRAM_DMA_Read(uint32_t adds, uint8_t *data, uint32_t len,
+*				  extRAM_DMA_CB cb)
+* Returns		: uint8_t ---> extRAM_OK if queued, else an extRAM_ERR_xxx code.
+* Arguments		: uint32_t adds ---> Start address inside the external RAM.
+*				  uint8_t *data ---> Caller buffer to read into.
+*				  uint32_t len ---> Number of bytes to read.
+*				  extRAM_DMA_CB cb ---> Called on completion, may be NULL.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Queues a read and returns immediately.
+*               :
+* Notes			: The buffer content is valid only after the callback is called.
+* Global Variables Affected	: NA
+******************************************************************************************/
+uint8_t extRAM_DMA_Read(uint32_t adds, uint8_t *data, uint32_t len, extRAM_DMA_CB cb)
+{
+	return extRAM_DMA_Queue(adds, data, len, extRAM_DMA_DIR_READ, cb);
+}
+
+/*****************************************************************************
+* Function name	: uint8_t extRAM_DMA_Is_Busy(void)
+* Returns		: uint8_t ---> 1 while any request is queued or running.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Other SPI users (e.g. external flash) must check this before
+*				  taking the bus.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+uint8_t extRAM_DMA_Is_Busy(void)
+{
+	return gb_extRAM_dma_busy_f;
+}
+
+/*****************************************************************************
+* Function name	: void extRAM_DMA_Wait(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Blocks till every queued request has completed.
+*               :
+* Notes			: Must not be called from SPI_Handler or a callback.
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_DMA_Wait(void)
+{
+	Assert(dma_in_cb == 0);
+	while (gb_extRAM_dma_busy_f);
+}
+
+/*****************************************************************************************
+* Function name	: static uint8_t extRAM_DMA_Queue(uint32_t adds, uint8_t *data, uint32_t len,
+*				  uint8_t dir, extRAM_DMA_CB cb)
+* Returns		: uint8_t ---> extRAM_OK if queued, else an extRAM_ERR_xxx code.
+* Arguments		: Same as extRAM_DMA_Write / extRAM_DMA_Read, dir selects which.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Adds a request to the tail of the queue and starts it if the bus
+*				  is idle.
+*               :
+* Notes			: SPI interrupt is masked while the queue is modified. Nothing is
+*				  started from a callback or while a blocking transfer owns the
+*				  bus, extRAM_DMA_Finish / SPI_Handler start the request later.
+* Global Variables Affected	: gb_extRAM_dma_busy_f
+******************************************************************************************/
+static uint8_t extRAM_DMA_Queue(uint32_t adds, uint8_t *data, uint32_t len, uint8_t dir, extRAM_DMA_CB cb)
+{
+	uint8_t sts = extRAM_Check_Range(adds, len);
+	if (sts != extRAM_OK)
+	{
+		return sts;
+	}
+
+	NVIC_DisableIRQ(SPI_IRQn);
+	if (dma_count >= extRAM_DMA_QUEUE_LEN)
+	{
+		NVIC_EnableIRQ(SPI_IRQn);
+
+		#if extRAM_DEBUG_DMA
+		Print_Message("\nextRAM DMA queue is full.");
+		#endif
+		return extRAM_ERR_BUSY;
+	}
+
+	RAM_DMA_REQ *req = &dma_queue[(dma_head + dma_count) % extRAM_DMA_QUEUE_LEN];
+	req->adds = adds;
+	req->data = data;
+	req->len = len;
+	req->dir = dir;
+	req->cb = cb;
+	dma_count ++;
+	gb_extRAM_dma_busy_f = 1;
+
+	if ((!dma_active) && (!dma_in_cb) && (!gb_extRAM_cpu_owner_f))
+	{
+		extRAM_DMA_Start();
+	}
+	NVIC_EnableIRQ(SPI_IRQn);
+
+	return extRAM_OK;
+}
+
+/*****************************************************************************
+* Function name	: static void extRAM_DMA_Start(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Sends the command of the request at the queue head and hands
+*				  the first data chunk to the PDC.
+*               :
+* Notes			: The mode register (if needed) and the 4 command bytes are sent
+*				  by the CPU (about 32 us at 1 MHz).
+* Global Variables Affected	: NA
+*****************************************************************************/
+static void extRAM_DMA_Start(void)
+{
+	RAM_DMA_REQ *req = &dma_queue[dma_head];
+
+	extRAM_Load_Command(dma_cmd_data, (req->dir == extRAM_DMA_DIR_READ) ? extRAM_READ_MEMORY : extRAM_WRITE_TO_MEM, req->adds);
+	dma_cur_ptr = req->data;
+	dma_remaining = req->len;
+
+	dma_active = 1;
+	extRAM_Select_Mode(req->adds, req->len);
+	CS2_PIN_LOW;
+	Data_To_SPI(dma_cmd_data, 4);
+	Wait_SPI_TX_Empty();
+	(void)SPI->SPI_RDR;	// Drop the byte received with the command, else the RX PDC takes it.
+
+	extRAM_DMA_Load_Chunk();
+}
+
+/*****************************************************************************
+* Function name	: static void extRAM_DMA_Load_Chunk(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Programs the PDC with the next chunk (at most extRAM_PDC_MX_CHUNK
+*				  bytes) of the active request. Chip select stays low between
+*				  chunks so the RAM keeps counting the address.
+*               :
+* Notes			: For a read the TX PDC sends the caller buffer itself as dummy
+*				  bytes, each byte is sent before the RX PDC overwrites it.
+* Global Variables Affected	: NA
+*****************************************************************************/
+static void extRAM_DMA_Load_Chunk(void)
+{
+	pdc_packet_t packet;
+	uint32_t chunk = (dma_remaining > extRAM_PDC_MX_CHUNK) ? extRAM_PDC_MX_CHUNK : dma_remaining;
+
+	packet.ul_addr = (uint32_t)dma_cur_ptr;
+	packet.ul_size = chunk;
+	dma_cur_ptr += chunk;
+	dma_remaining -= chunk;
+
+	if (dma_queue[dma_head].dir == extRAM_DMA_DIR_READ)
+	{
+		pdc_rx_init(dma_pdc, &packet, NULL);
+		pdc_tx_init(dma_pdc, &packet, NULL);
+		spi_enable_interrupt(SPI, SPI_IER_ENDRX);
+		pdc_enable_transfer(dma_pdc, PERIPH_PTCR_RXTEN | PERIPH_PTCR_TXTEN);
+	}
+	else
+	{
+		pdc_tx_init(dma_pdc, &packet, NULL);
+		spi_enable_interrupt(SPI, SPI_IER_ENDTX);
+		pdc_enable_transfer(dma_pdc, PERIPH_PTCR_TXTEN);
+	}
+}
+
+/*****************************************************************************
+* Function name	: static void extRAM_DMA_Finish(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Releases chip select, calls the callback of the completed
+*				  request and then starts the next one from the queue, which
+*				  may include requests the callback queued.
+*               :
+* Notes			: Runs in SPI_Handler context.
+* Global Variables Affected	: gb_extRAM_dma_busy_f
+*****************************************************************************/
+static void extRAM_DMA_Finish(void)
+{
+	RAM_DMA_REQ done = dma_queue[dma_head];
+
+	pdc_disable_transfer(dma_pdc, PERIPH_PTCR_RXTDIS | PERIPH_PTCR_TXTDIS);
+	CS2_PIN_HIGH;
+
+	dma_head = (dma_head + 1) % extRAM_DMA_QUEUE_LEN;
+	dma_count --;
+	dma_active = 0;
+
+	if (done.cb != NULL)
+	{
+		dma_in_cb = 1;
+		done.cb(done.data, done.len);
+		dma_in_cb = 0;
+	}
+
+	if (dma_count > 0)
+	{
+		extRAM_DMA_Start();
+	}
+	else
+	{
+		gb_extRAM_dma_busy_f = 0;
+	}
+}
+
+/*****************************************************************************
+* Function name	: void SPI_Handler(void)
+* Returns		: Nothing.
+* Arguments		: None.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: SPI interrupt service routine.
+*				  ENDRX ---> a read chunk is in memory.
+*				  ENDTX ---> a write chunk is handed to the shifter, wait for
+*				             TXEMPTY before chip select is released.
+*				  Pended by ext_ram.c after a blocking transfer, starts the
+*				  requests queued meanwhile.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+void SPI_Handler(void)
+{
+	uint32_t status = spi_read_status(SPI) & SPI->SPI_IMR;
+
+	if (status & SPI_SR_ENDRX)
+	{
+		spi_disable_interrupt(SPI, SPI_IDR_ENDRX);
+		if (dma_remaining > 0)
+		{
+			extRAM_DMA_Load_Chunk();
+		}
+		else
+		{
+			extRAM_DMA_Finish();
+		}
+	}
+
+	if (status & SPI_SR_ENDTX)
+	{
+		spi_disable_interrupt(SPI, SPI_IDR_ENDTX);
+		if (dma_remaining > 0)
+		{
+			extRAM_DMA_Load_Chunk();
+		}
+		else
+		{
+			spi_enable_interrupt(SPI, SPI_IER_TXEMPTY);
+		}
+	}
+
+	if (status & SPI_SR_TXEMPTY)
+	{
+		spi_disable_interrupt(SPI, SPI_IDR_TXEMPTY);
+		extRAM_DMA_Finish();
+	}
+
+	if ((!dma_active) && (dma_count > 0) && (!gb_extRAM_cpu_owner_f))
+	{
+		extRAM_DMA_Start();
+	}
+}
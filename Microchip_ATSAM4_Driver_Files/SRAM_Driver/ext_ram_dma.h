@@ -0,0 +1,56 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_dma.h
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Header file for ext_ram_dma.c
+*				  Defines constants and macros for the PDC based (non-blocking)
+*				  external RAM transfers.
+*
+*****************************************************************************/
+#ifndef EXT_RAM_DMA_H_
+#define EXT_RAM_DMA_H_
+
+#include "asf.h"
+#include "ext_ram.h"
+
+/***** MACROS / DEFINITIONS FOR THE DRIVER *****/
+#ifndef extRAM_DMA_QUEUE_LEN
+#define extRAM_DMA_QUEUE_LEN	4		// Number of requests that can wait for the bus.
+#endif
+
+#ifndef extRAM_DMA_IRQ_PRIORITY
+#define extRAM_DMA_IRQ_PRIORITY	2		// Lower the value highest in the priority.
+#endif
+
+#define extRAM_PDC_MX_CHUNK		65535	// PDC counter registers are 16 bit wide.
+
+#define extRAM_DMA_DIR_WRITE	0
+#define extRAM_DMA_DIR_READ		1
+
+/***** DEBUG MESSAGES *****/
+#define extRAM_DEBUG_DMA		(0)
+/***** END OF DEBUG MESSAGES *****/
+
+/***** Type Declarations *****/
+/* Called from SPI_Handler when a request completes, data and len are the request's.
+   It may queue new requests but must not call the blocking extRAM_xxx functions. */
+typedef void (*extRAM_DMA_CB)(U8 *data, U32 len);
+
+typedef struct
+{
+	U32 adds;			// Start address inside the external RAM.
+	U8 *data;			// Caller buffer, must stay valid until the callback.
+	U32 len;			// Total bytes of the request.
+	U8 dir;				// extRAM_DMA_DIR_WRITE or extRAM_DMA_DIR_READ.
+	extRAM_DMA_CB cb;	// Completion callback, may be NULL.
+}RAM_DMA_REQ;
+
+/***** Function Prototypes *****/
+void extRAM_DMA_Init(void);
+U8 extRAM_DMA_Write(U32 adds, U8 *data, U32 len, extRAM_DMA_CB cb);
+U8 extRAM_DMA_Read(U32 adds, U8 *data, U32 len, extRAM_DMA_CB cb);
+U8 extRAM_DMA_Is_Busy(void);
+void extRAM_DMA_Wait(void);
+#endif /* EXT_RAM_DMA_H_ */
@@ -0,0 +1,356 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_fifo.c
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Record FIFO whose storage is a ring in the external RAM.
+*				  Small pushes are collected in an internal RAM tail buffer and
+*				  written to the ring in one SPI burst when it fills, pops are
+*				  served from an internal RAM head buffer refilled by one burst.
+*				  When the consumer keeps up, records go from the tail buffer
+*				  to the reader without touching the SPI bus at all.
+*
+*				  Logical order of bytes : head buffer -> ring -> tail buffer.
+*
+* Controller	: 	ATSAM4E16CA-AUR
+*					1024 KB		Flash.
+*					128 KB		RAM.
+*
+*****************************************************************************/
+
+#include "ext_ram_fifo.h"
+#include "string.h"
+#include "user_uart.h"
+
+static void extRAM_FIFO_Ring_Write(RAM_FIFO *fifo, const U8 *src, U32 len);
+static void extRAM_FIFO_Ring_Read(RAM_FIFO *fifo, U8 *dst, U32 len);
+static void extRAM_FIFO_Put(RAM_FIFO *fifo, const U8 *src, U32 len);
+static void extRAM_FIFO_Get(RAM_FIFO *fifo, U8 *dst, U32 len);
+
+/*****************************************************************************
+* Function name	: void extRAM_FIFO_Init(RAM_FIFO *fifo, U32 base, U32 size)
+* Returns		: Nothing.
+* Arguments		: RAM_FIFO *fifo ---> FIFO object in internal RAM.
+*				  U32 base ---> First external RAM address of the ring.
+*				  U32 size ---> Ring size in bytes.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Empties the FIFO and clears the counters.
+*               :
+* Notes			: base and size may come from extRAM_Arena_Alloc. Bursts that
+*				  cross a page switch the RAM to sequential mode by themselves.
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_FIFO_Init(RAM_FIFO *fifo, U32 base, U32 size)
+{
+	memset(fifo, 0, sizeof(RAM_FIFO));
+	fifo->base = base;
+	fifo->size = size;
+}
+
+/*****************************************************************************
+* Function name	: U32 extRAM_FIFO_Free_Space(RAM_FIFO *fifo)
+* Returns		: U32 ---> Bytes that can still be pushed (headers included).
+* Arguments		: RAM_FIFO *fifo ---> FIFO object.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Free room of the ring plus free room of the tail buffer.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+U32 extRAM_FIFO_Free_Space(RAM_FIFO *fifo)
+{
+	return (fifo->size - fifo->ring_count) + (extRAM_FIFO_STAGE_SIZE - fifo->wr_len);
+}
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_FIFO_Push(RAM_FIFO *fifo, const U8 *data, U16 len)
+* Returns		: U8 ---> extRAM_OK, extRAM_ERR_FULL if the record was dropped.
+* Arguments		: RAM_FIFO *fifo ---> FIFO object.
+*				  const U8 *data ---> Record to store.
+*				  U16 len ---> Record length.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Appends a record. A record that does not fit is dropped whole
+*				  and counted in overflow, a partial record is never stored.
+*               :
+* Notes			: Not re-entrant, call from the main loop only.
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_FIFO_Push(RAM_FIFO *fifo, const U8 *data, U16 len)
+{
+	U8 hdr[extRAM_FIFO_REC_HDR];
+
+	if ((U32)len + extRAM_FIFO_REC_HDR > extRAM_FIFO_Free_Space(fifo))
+	{
+		fifo->overflow ++;
+
+		#if extRAM_DEBUG_FIFO
+		Print_Message("\nextRAM FIFO overflow, record dropped.");
+		#endif
+		return extRAM_ERR_FULL;
+	}
+
+	hdr[0] = (U8)(len & 0xFF);
+	hdr[1] = (U8)(len >> 8);
+	extRAM_FIFO_Put(fifo, hdr, extRAM_FIFO_REC_HDR);
+	extRAM_FIFO_Put(fifo, data, len);
+
+	fifo->count += len + extRAM_FIFO_REC_HDR;
+	fifo->records ++;
+	if (fifo->count > fifo->high_water)
+	{
+		fifo->high_water = fifo->count;
+	}
+
+	return extRAM_OK;
+}
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_FIFO_Pop(RAM_FIFO *fifo, U8 *data, U16 max_len, U16 *len)
+* Returns		: U8 ---> extRAM_OK, extRAM_ERR_EMPTY if there is no record,
+*				  extRAM_ERR_LENGTH if the record was longer than max_len.
+* Arguments		: RAM_FIFO *fifo ---> FIFO object.
+*				  U8 *data ---> Buffer for the record.
+*				  U16 max_len ---> Size of the buffer.
+*				  U16 *len ---> Filled with the stored record length.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Removes the oldest record. If it is longer than max_len the
+*				  first max_len bytes are copied and the rest is discarded.
+*               :
+* Notes			: Not re-entrant, call from the main loop only.
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_FIFO_Pop(RAM_FIFO *fifo, U8 *data, U16 max_len, U16 *len)
+{
+	U8 hdr[extRAM_FIFO_REC_HDR];
+	U16 rec_len;
+	U16 copy_len;
+
+	if (fifo->records == 0)
+	{
+		*len = 0;
+		return extRAM_ERR_EMPTY;
+	}
+
+	extRAM_FIFO_Get(fifo, hdr, extRAM_FIFO_REC_HDR);
+	rec_len = hdr[0] | ((U16)hdr[1] << 8);
+	copy_len = (rec_len > max_len) ? max_len : rec_len;
+
+	extRAM_FIFO_Get(fifo, data, copy_len);
+	extRAM_FIFO_Get(fifo, NULL, rec_len - copy_len);
+
+	fifo->count -= rec_len + extRAM_FIFO_REC_HDR;
+	fifo->records --;
+	*len = rec_len;
+
+	return (copy_len < rec_len) ? extRAM_ERR_LENGTH : extRAM_OK;
+}
+
+/*****************************************************************************
+* Function name	: void extRAM_FIFO_Flush(RAM_FIFO *fifo)
+* Returns		: Nothing.
+* Arguments		: RAM_FIFO *fifo ---> FIFO object.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Moves as much of the tail buffer into the ring as the ring has
+*				  room for, in one burst.
+*               :
+* Notes			: Called automatically when the tail buffer fills. Call it
+*				  before a long idle period to empty the tail buffer.
+* Global Variables Affected	: NA
+*****************************************************************************/
+void extRAM_FIFO_Flush(RAM_FIFO *fifo)
+{
+	U32 room = fifo->size - fifo->ring_count;
+	U16 flush_len = (fifo->wr_len > room) ? (U16)room : fifo->wr_len;
+
+	if (flush_len == 0)
+	{
+		return;
+	}
+
+	extRAM_FIFO_Ring_Write(fifo, fifo->wr_stage, flush_len);
+	fifo->wr_len -= flush_len;
+	if (fifo->wr_len > 0)
+	{
+		memmove(fifo->wr_stage, &fifo->wr_stage[flush_len], fifo->wr_len);
+	}
+}
+
+/*****************************************************************************
+* Function name	: static void extRAM_FIFO_Put(RAM_FIFO *fifo, const U8 *src, U32 len)
+* Returns		: Nothing.
+* Arguments		: RAM_FIFO *fifo ---> FIFO object.
+*				  const U8 *src, U32 len ---> Bytes to append.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Appends bytes through the tail buffer. A long run with an empty
+*				  tail buffer is written from the caller memory straight to the
+*				  ring.
+*               :
+* Notes			: Caller has checked the free space.
+* Global Variables Affected	: NA
+*****************************************************************************/
+static void extRAM_FIFO_Put(RAM_FIFO *fifo, const U8 *src, U32 len)
+{
+	while (len > 0)
+	{
+		U32 room = fifo->size - fifo->ring_count;
+
+		if ((fifo->wr_len == 0) && (len >= extRAM_FIFO_STAGE_SIZE) && (room > 0))
+		{
+			U32 direct = (len > room) ? room : len;
+
+			extRAM_FIFO_Ring_Write(fifo, src, direct);
+			src += direct;
+			len -= direct;
+			continue;
+		}
+
+		U16 copy_len = extRAM_FIFO_STAGE_SIZE - fifo->wr_len;
+		if (copy_len > len)
+		{
+			copy_len = len;
+		}
+
+		memcpy(&fifo->wr_stage[fifo->wr_len], src, copy_len);
+		fifo->wr_len += copy_len;
+		src += copy_len;
+		len -= copy_len;
+
+		if (fifo->wr_len == extRAM_FIFO_STAGE_SIZE)
+		{
+			extRAM_FIFO_Flush(fifo);
+		}
+	}
+}
+
+/*****************************************************************************
+* Function name	: static void extRAM_FIFO_Get(RAM_FIFO *fifo, U8 *dst, U32 len)
+* Returns		: Nothing.
+* Arguments		: RAM_FIFO *fifo ---> FIFO object.
+*				  U8 *dst ---> Destination, NULL to discard the bytes.
+*				  U32 len ---> Bytes to remove.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Removes the oldest bytes: head buffer first, then the ring
+*				  (refilling the head buffer in one burst, or reading a long run
+*				  straight into dst), then the tail buffer.
+*               :
+* Notes			: Caller has checked that len bytes are present.
+* Global Variables Affected	: NA
+*****************************************************************************/
+static void extRAM_FIFO_Get(RAM_FIFO *fifo, U8 *dst, U32 len)
+{
+	while (len > 0)
+	{
+		U32 copy_len;
+
+		if (fifo->rd_pos < fifo->rd_len)
+		{
+			copy_len = fifo->rd_len - fifo->rd_pos;
+			if (copy_len > len)
+			{
+				copy_len = len;
+			}
+			if (dst != NULL)
+			{
+				memcpy(dst, &fifo->rd_stage[fifo->rd_pos], copy_len);
+				dst += copy_len;
+			}
+			fifo->rd_pos += copy_len;
+		}
+		else if (fifo->ring_count > 0)
+		{
+			copy_len = (fifo->ring_count > len) ? len : fifo->ring_count;
+			if ((dst != NULL) && (copy_len >= extRAM_FIFO_STAGE_SIZE))
+			{
+				extRAM_FIFO_Ring_Read(fifo, dst, copy_len);
+				dst += copy_len;
+			}
+			else
+			{
+				U16 fill_len = (fifo->ring_count > extRAM_FIFO_STAGE_SIZE) ? extRAM_FIFO_STAGE_SIZE : (U16)fifo->ring_count;
+
+				extRAM_FIFO_Ring_Read(fifo, fifo->rd_stage, fill_len);
+				fifo->rd_pos = 0;
+				fifo->rd_len = fill_len;
+				continue;
+			}
+		}
+		else
+		{
+			copy_len = (fifo->wr_len > len) ? len : fifo->wr_len;
+			if (dst != NULL)
+			{
+				memcpy(dst, fifo->wr_stage, copy_len);
+				dst += copy_len;
+			}
+			fifo->wr_len -= copy_len;
+			memmove(fifo->wr_stage, &fifo->wr_stage[copy_len], fifo->wr_len);
+		}
+
+		len -= copy_len;
+	}
+}
+
+/*****************************************************************************
+* Function name	: static void extRAM_FIFO_Ring_Write(RAM_FIFO *fifo, const U8 *src, U32 len)
+* Returns		: Nothing.
+* Arguments		: RAM_FIFO *fifo ---> FIFO object.
+*				  const U8 *src, U32 len ---> Bytes to store at the ring write offset.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: One burst, or two when the ring wraps.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static void extRAM_FIFO_Ring_Write(RAM_FIFO *fifo, const U8 *src, U32 len)
+{
+	U32 first_len = fifo->size - fifo->wr_off;
+
+	if (first_len > len)
+	{
+		first_len = len;
+	}
+
+	extRAM_Write(fifo->base + fifo->wr_off, src, first_len);
+	fifo->wr_bursts ++;
+	if (len > first_len)
+	{
+		extRAM_Write(fifo->base, &src[first_len], len - first_len);
+		fifo->wr_bursts ++;
+	}
+
+	fifo->wr_off = (fifo->wr_off + len) % fifo->size;
+	fifo->ring_count += len;
+}
+
+/*****************************************************************************
+* Function name	: static void extRAM_FIFO_Ring_Read(RAM_FIFO *fifo, U8 *dst, U32 len)
+* Returns		: Nothing.
+* Arguments		: RAM_FIFO *fifo ---> FIFO object.
+*				  U8 *dst, U32 len ---> Buffer for the bytes at the ring read offset.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: One burst, or two when the ring wraps.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static void extRAM_FIFO_Ring_Read(RAM_FIFO *fifo, U8 *dst, U32 len)
+{
+	U32 first_len = fifo->size - fifo->rd_off;
+
+	if (first_len > len)
+	{
+		first_len = len;
+	}
+
+	extRAM_Read(fifo->base + fifo->rd_off, dst, first_len);
+	fifo->rd_bursts ++;
+	if (len > first_len)
+	{
+		extRAM_Read(fifo->base, &dst[first_len], len - first_len);
+		fifo->rd_bursts ++;
+	}
+
+	fifo->rd_off = (fifo->rd_off + len) % fifo->size;
+	fifo->ring_count -= len;
+}
@@ -0,0 +1,62 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_fifo.h
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Header file for ext_ram_fifo.c
+*				  Defines the record FIFO whose storage is in the external RAM.
+*
+*****************************************************************************/
+#ifndef EXT_RAM_FIFO_H_
+#define EXT_RAM_FIFO_H_
+
+#include "asf.h"
+#include "ext_ram.h"
+
+/***** MACROS / DEFINITIONS FOR THE FIFO *****/
+#ifndef extRAM_FIFO_STAGE_SIZE
+#define extRAM_FIFO_STAGE_SIZE	128		// Bytes of each internal RAM staging buffer (one SPI burst).
+#endif
+
+#define extRAM_FIFO_REC_HDR		2		// Every record is preceded by its 16 bit length.
+
+/***** DEBUG MESSAGES *****/
+#define extRAM_DEBUG_FIFO		(0)
+/***** END OF DEBUG MESSAGES *****/
+
+/***** Structure Declarations *****/
+typedef struct
+{
+	/* Ring in the external RAM */
+	U32 base;							// First RAM address of the ring.
+	U32 size;							// Ring size in bytes.
+	U32 wr_off;							// Ring offset of the next flushed byte.
+	U32 rd_off;							// Ring offset of the oldest byte.
+	U32 ring_count;						// Bytes held in the ring.
+
+	/* Tail staging, newest bytes not yet written to the ring */
+	U8 wr_stage[extRAM_FIFO_STAGE_SIZE];
+	U16 wr_len;
+
+	/* Head staging, oldest bytes already read out of the ring */
+	U8 rd_stage[extRAM_FIFO_STAGE_SIZE];
+	U16 rd_pos;
+	U16 rd_len;
+
+	/* Counters */
+	U32 count;							// Bytes in the FIFO (headers included).
+	U32 records;						// Records in the FIFO.
+	U32 high_water;						// Maximum of count since init.
+	U32 overflow;						// Records dropped because the FIFO was full.
+	U32 wr_bursts;						// SPI write bursts issued.
+	U32 rd_bursts;						// SPI read bursts issued.
+}RAM_FIFO;
+
+/***** Function Prototypes *****/
+void extRAM_FIFO_Init(RAM_FIFO *fifo, U32 base, U32 size);
+U8 extRAM_FIFO_Push(RAM_FIFO *fifo, const U8 *data, U16 len);
+U8 extRAM_FIFO_Pop(RAM_FIFO *fifo, U8 *data, U16 max_len, U16 *len);
+void extRAM_FIFO_Flush(RAM_FIFO *fifo);
+U32 extRAM_FIFO_Free_Space(RAM_FIFO *fifo);
+#endif /* EXT_RAM_FIFO_H_ */
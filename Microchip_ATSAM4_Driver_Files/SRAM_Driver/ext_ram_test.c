@@ -0,0 +1,437 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_test.c
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Production / bring-up test of the external RAM.
+*				  March C- and checkerboard tests over any range in sequential
+*				  bursts, and a benchmark that times write and read
+*				  transactions for several burst sizes.
+*
+*				  All tests are destructive, the tested range must not hold
+*				  live data.
+*
+* Controller	: 	ATSAM4E16CA-AUR
+*					1024 KB		Flash.
+*					128 KB		RAM.
+*
+*****************************************************************************/
+
+#include "ext_ram_test.h"
+#include "string.h"
+#include "user_uart.h"
+
+#define MARCH_UP		1
+#define MARCH_DOWN		0
+#define MARCH_NONE		0xFFFF		// No read or no write in the element.
+
+/***** Local variables *****/
+static U8 test_buf[extRAM_TEST_MX_BURST];		// Data read back from the RAM.
+static U8 pat_buf[extRAM_TEST_MX_BURST];		// Expected / written pattern.
+static const U16 bench_burst[extRAM_BENCH_BURST_CNT] = {1, 4, 32, 128, 512};
+
+static U8 Test_Check_Args(U32 adds, U32 len, U16 burst, RAM_TEST_RESULT *result);
+static U8 Test_Verify(U32 adds, U32 len, RAM_TEST_RESULT *result);
+static U8 Test_March_Element(U32 adds, U32 len, U16 burst, U8 dir, U16 rd_val, U16 wr_val, RAM_TEST_RESULT *result);
+static void Test_Fill_Checker(U32 adds, U32 len, U8 inv);
+#if extRAM_DEBUG_TEST
+static void Test_Print_Result(const char *name, RAM_TEST_RESULT *result);
+#endif
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_Test_March_C(U32 adds, U32 len, U16 burst, RAM_TEST_RESULT *result)
+* Returns		: U8 ---> extRAM_OK, extRAM_ERR_VERIFY on a mismatch, else range error.
+* Arguments		: U32 adds ---> First address to test.
+*				  U32 len ---> Number of bytes to test.
+*				  U16 burst ---> Bytes per SPI transaction (1 to extRAM_TEST_MX_BURST).
+*				  RAM_TEST_RESULT *result ---> Filled with the outcome.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: March C- with 0x00 / 0xFF backgrounds :
+*				  {any(w0); up(r0,w1); up(r1,w0); down(r0,w1); down(r1,w0); any(r0)}
+*               :
+* Notes			: Each read / write of an element covers a whole burst, so the
+*				  element is applied burst by burst in the march order.
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_Test_March_C(U32 adds, U32 len, U16 burst, RAM_TEST_RESULT *result)
+{
+	U8 sts = Test_Check_Args(adds, len, burst, result);
+
+	if (sts == extRAM_OK)
+	{
+		sts = Test_March_Element(adds, len, burst, MARCH_UP, MARCH_NONE, 0x00, result);
+	}
+	if (sts == extRAM_OK)
+	{
+		sts = Test_March_Element(adds, len, burst, MARCH_UP, 0x00, 0xFF, result);
+	}
+	if (sts == extRAM_OK)
+	{
+		sts = Test_March_Element(adds, len, burst, MARCH_UP, 0xFF, 0x00, result);
+	}
+	if (sts == extRAM_OK)
+	{
+		sts = Test_March_Element(adds, len, burst, MARCH_DOWN, 0x00, 0xFF, result);
+	}
+	if (sts == extRAM_OK)
+	{
+		sts = Test_March_Element(adds, len, burst, MARCH_DOWN, 0xFF, 0x00, result);
+	}
+	if (sts == extRAM_OK)
+	{
+		sts = Test_March_Element(adds, len, burst, MARCH_UP, 0x00, MARCH_NONE, result);
+	}
+
+	result->status = sts;
+	#if extRAM_DEBUG_TEST
+	Test_Print_Result("March C-", result);
+	#endif
+	return sts;
+}
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_Test_Checkerboard(U32 adds, U32 len, U16 burst, RAM_TEST_RESULT *result)
+* Returns		: U8 ---> extRAM_OK, extRAM_ERR_VERIFY on a mismatch, else range error.
+* Arguments		: U32 adds ---> First address to test.
+*				  U32 len ---> Number of bytes to test.
+*				  U16 burst ---> Bytes per SPI transaction (1 to extRAM_TEST_MX_BURST).
+*				  RAM_TEST_RESULT *result ---> Filled with the outcome.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Writes 0x55 / 0xAA on alternate addresses over the whole range,
+*				  verifies it, then repeats with the inverted pattern.
+*               :
+* Notes			: The complete range is written before it is read back, so
+*				  address aliasing shows up as a mismatch.
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_Test_Checkerboard(U32 adds, U32 len, U16 burst, RAM_TEST_RESULT *result)
+{
+	U8 sts = Test_Check_Args(adds, len, burst, result);
+
+	for (U8 inv = 0; (inv < 2) && (sts == extRAM_OK); inv ++)
+	{
+		for (U32 off = 0; off < len; off += burst)
+		{
+			U32 n = ((len - off) < burst) ? (len - off) : burst;
+
+			Test_Fill_Checker(adds + off, n, inv);
+			extRAM_Write(adds + off, pat_buf, n);
+			extRAM_TEST_KICK_WDT();
+		}
+
+		for (U32 off = 0; (off < len) && (sts == extRAM_OK); off += burst)
+		{
+			U32 n = ((len - off) < burst) ? (len - off) : burst;
+
+			Test_Fill_Checker(adds + off, n, inv);
+			sts = Test_Verify(adds + off, n, result);
+			extRAM_TEST_KICK_WDT();
+		}
+	}
+
+	result->status = sts;
+	#if extRAM_DEBUG_TEST
+	Test_Print_Result("Checkerboard", result);
+	#endif
+	return sts;
+}
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_Benchmark(U32 adds, U32 len, RAM_BENCH_RESULT *result)
+* Returns		: U8 ---> extRAM_OK, else range error.
+* Arguments		: U32 adds ---> First address of the scratch area.
+*				  U32 len ---> Size of the scratch area in bytes.
+*				  RAM_BENCH_RESULT *result ---> Array of extRAM_BENCH_BURST_CNT entries.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: For every burst size in bench_burst times up to
+*				  extRAM_BENCH_MX_TXN write transactions and then the same reads
+*				  over the scratch area, and works out bandwidth and the average
+*				  time of one transaction.
+*               :
+* Notes			: Run it again after changing the SPI clock to compare.
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_Benchmark(U32 adds, U32 len, RAM_BENCH_RESULT *result)
+{
+	U8 sts = extRAM_Check_Range(adds, len);
+	U32 cpu_hz = extRAM_TEST_CPU_HZ();
+
+	if (sts != extRAM_OK)
+	{
+		return sts;
+	}
+
+	extRAM_TEST_TIMER_INIT();
+	memset(pat_buf, 0xA5, sizeof(pat_buf));
+
+	for (U8 bIdx = 0; bIdx < extRAM_BENCH_BURST_CNT; bIdx ++)
+	{
+		U16 burst = bench_burst[bIdx];
+		U32 txn = len / burst;
+		U32 start, wr_cyc, rd_cyc;
+
+		if (txn > extRAM_BENCH_MX_TXN)
+		{
+			txn = extRAM_BENCH_MX_TXN;
+		}
+
+		memset(&result[bIdx], 0, sizeof(RAM_BENCH_RESULT));
+		result[bIdx].burst = burst;
+		if (txn == 0)
+		{
+			continue;
+		}
+
+		start = extRAM_TEST_CYCLES();
+		for (U32 tIdx = 0; tIdx < txn; tIdx ++)
+		{
+			extRAM_Write(adds + (tIdx * burst), pat_buf, burst);
+		}
+		wr_cyc = extRAM_TEST_CYCLES() - start;
+		extRAM_TEST_KICK_WDT();
+
+		start = extRAM_TEST_CYCLES();
+		for (U32 tIdx = 0; tIdx < txn; tIdx ++)
+		{
+			extRAM_Read(adds + (tIdx * burst), test_buf, burst);
+		}
+		rd_cyc = extRAM_TEST_CYCLES() - start;
+		extRAM_TEST_KICK_WDT();
+
+		if (wr_cyc == 0)
+		{
+			wr_cyc = 1;
+		}
+		if (rd_cyc == 0)
+		{
+			rd_cyc = 1;
+		}
+
+		result[bIdx].wr_bytes_per_sec = (U32)(((uint64_t)txn * burst * cpu_hz) / wr_cyc);
+		result[bIdx].rd_bytes_per_sec = (U32)(((uint64_t)txn * burst * cpu_hz) / rd_cyc);
+		result[bIdx].wr_ns_per_txn = (U32)(((uint64_t)wr_cyc * 1000000000) / cpu_hz / txn);
+		result[bIdx].rd_ns_per_txn = (U32)(((uint64_t)rd_cyc * 1000000000) / cpu_hz / txn);
+
+		#if extRAM_DEBUG_TEST
+		Print_Message("\nextRAM bench burst : ");
+		Print_Number(burst);
+		Print_Message(" wr B/s : ");
+		Print_Number(result[bIdx].wr_bytes_per_sec);
+		Print_Message(" rd B/s : ");
+		Print_Number(result[bIdx].rd_bytes_per_sec);
+		Print_Message(" wr ns/txn : ");
+		Print_Number(result[bIdx].wr_ns_per_txn);
+		Print_Message(" rd ns/txn : ");
+		Print_Number(result[bIdx].rd_ns_per_txn);
+		#endif
+	}
+
+	return extRAM_OK;
+}
+
+/*****************************************************************************************
+* Function name	: U8 extRAM_Test_Run_All(RAM_TEST_RESULT *march, RAM_TEST_RESULT *checker,
+*				  RAM_BENCH_RESULT *bench)
+* Returns		: U8 ---> extRAM_OK if both tests pass and the benchmark ran,
+*				  else the first error.
+* Arguments		: RAM_TEST_RESULT *march ---> Filled with the March C- outcome.
+*				  RAM_TEST_RESULT *checker ---> Filled with the checkerboard outcome
+*				  (status extRAM_ERR_VERIFY with 0 bytes checked if March C- failed).
+*				  RAM_BENCH_RESULT *bench ---> Array of extRAM_BENCH_BURST_CNT entries.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Runs March C- and checkerboard from address 0 to extRAM_TEST_END
+*				  with the largest burst, then the benchmark over the start of
+*				  the device.
+*               :
+* Notes			: Erases the external RAM below extRAM_TEST_END, the checkpoint
+*				  slots (ext_ram_ckpt.c) are not touched. Call before ext_ram_alloc.c
+*				  and the other users of the RAM are initialised.
+* Global Variables Affected	: NA
+******************************************************************************************/
+U8 extRAM_Test_Run_All(RAM_TEST_RESULT *march, RAM_TEST_RESULT *checker, RAM_BENCH_RESULT *bench)
+{
+	U32 bench_len = (U32)extRAM_TEST_MX_BURST * extRAM_BENCH_MX_TXN;
+	U8 sts, bench_sts;
+
+	sts = extRAM_Test_March_C(0, extRAM_TEST_END, extRAM_TEST_MX_BURST, march);
+	if (sts == extRAM_OK)
+	{
+		sts = extRAM_Test_Checkerboard(0, extRAM_TEST_END, extRAM_TEST_MX_BURST, checker);
+	}
+	else
+	{
+		memset(checker, 0, sizeof(RAM_TEST_RESULT));
+		checker->status = extRAM_ERR_VERIFY;		// Not run.
+	}
+
+	if (bench_len > extRAM_TEST_END)
+	{
+		bench_len = extRAM_TEST_END;
+	}
+	bench_sts = extRAM_Benchmark(0, bench_len, bench);
+
+	return (sts != extRAM_OK) ? sts : bench_sts;
+}
+
+/*****************************************************************************
+* Function name	: static U8 Test_Check_Args(U32 adds, U32 len, U16 burst, RAM_TEST_RESULT *result)
+* Returns		: U8 ---> extRAM_OK or the range error.
+* Arguments		: Same as the test functions.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Validates the range and burst and clears the result.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static U8 Test_Check_Args(U32 adds, U32 len, U16 burst, RAM_TEST_RESULT *result)
+{
+	memset(result, 0, sizeof(RAM_TEST_RESULT));
+
+	if ((burst == 0) || (burst > extRAM_TEST_MX_BURST))
+	{
+		result->status = extRAM_ERR_LENGTH;
+		return extRAM_ERR_LENGTH;
+	}
+
+	result->status = extRAM_Check_Range(adds, len);
+	return result->status;
+}
+
+/*****************************************************************************
+* Function name	: static U8 Test_Verify(U32 adds, U32 len, RAM_TEST_RESULT *result)
+* Returns		: U8 ---> extRAM_OK or extRAM_ERR_VERIFY.
+* Arguments		: U32 adds ---> Address of the burst.
+*				  U32 len ---> Bytes in the burst.
+*				  RAM_TEST_RESULT *result ---> Updated with the first mismatch.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Reads one burst into test_buf and compares it with pat_buf.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static U8 Test_Verify(U32 adds, U32 len, RAM_TEST_RESULT *result)
+{
+	extRAM_Read(adds, test_buf, len);
+
+	if (memcmp(test_buf, pat_buf, len) != 0)
+	{
+		for (U32 idx = 0; idx < len; idx ++)
+		{
+			if (test_buf[idx] != pat_buf[idx])
+			{
+				result->fail_adds = adds + idx;
+				result->expected = pat_buf[idx];
+				result->actual = test_buf[idx];
+				result->bytes_checked += idx;
+				break;
+			}
+		}
+		return extRAM_ERR_VERIFY;
+	}
+
+	result->bytes_checked += len;
+	return extRAM_OK;
+}
+
+/*****************************************************************************
+* Function name	: static U8 Test_March_Element(U32 adds, U32 len, U16 burst, U8 dir,
+*				  U16 rd_val, U16 wr_val, RAM_TEST_RESULT *result)
+* Returns		: U8 ---> extRAM_OK or extRAM_ERR_VERIFY.
+* Arguments		: U8 dir ---> MARCH_UP or MARCH_DOWN.
+*				  U16 rd_val ---> Expected byte, MARCH_NONE to skip the read.
+*				  U16 wr_val ---> Byte to write, MARCH_NONE to skip the write.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Applies one march element (read then write) to every burst of
+*				  the range in the given direction.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static U8 Test_March_Element(U32 adds, U32 len, U16 burst, U8 dir, U16 rd_val, U16 wr_val, RAM_TEST_RESULT *result)
+{
+	U32 bursts = (len + burst - 1) / burst;
+
+	for (U32 bIdx = 0; bIdx < bursts; bIdx ++)
+	{
+		U32 off = (dir == MARCH_UP) ? (bIdx * burst) : ((bursts - 1 - bIdx) * burst);
+		U32 n = ((len - off) < burst) ? (len - off) : burst;
+
+		if (rd_val != MARCH_NONE)
+		{
+			memset(pat_buf, (U8)rd_val, n);
+			if (Test_Verify(adds + off, n, result) != extRAM_OK)
+			{
+				return extRAM_ERR_VERIFY;
+			}
+		}
+		if (wr_val != MARCH_NONE)
+		{
+			memset(pat_buf, (U8)wr_val, n);
+			extRAM_Write(adds + off, pat_buf, n);
+		}
+
+		if ((bIdx % 64) == 0)
+		{
+			extRAM_TEST_KICK_WDT();
+		}
+	}
+
+	return extRAM_OK;
+}
+
+/*****************************************************************************
+* Function name	: static void Test_Fill_Checker(U32 adds, U32 len, U8 inv)
+* Returns		: Nothing.
+* Arguments		: U32 adds ---> RAM address of pat_buf[0].
+*				  U32 len ---> Bytes to fill.
+*				  U8 inv ---> 1 for the inverted pattern.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Fills pat_buf with 0x55 on even and 0xAA on odd addresses
+*				  (swapped when inv is set).
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static void Test_Fill_Checker(U32 adds, U32 len, U8 inv)
+{
+	for (U32 idx = 0; idx < len; idx ++)
+	{
+		pat_buf[idx] = (((adds + idx) ^ inv) & 1) ? 0xAA : 0x55;
+	}
+}
+
+#if extRAM_DEBUG_TEST
+/*****************************************************************************
+* Function name	: static void Test_Print_Result(const char *name, RAM_TEST_RESULT *result)
+* Returns		: Nothing.
+* Arguments		: const char *name ---> Test name.
+*				  RAM_TEST_RESULT *result ---> Outcome to print.
+* Created by	: Anup Silvan Mascarenhas
+* Description	: Prints the outcome on the debug UART.
+*               :
+* Notes			: NA
+* Global Variables Affected	: NA
+*****************************************************************************/
+static void Test_Print_Result(const char *name, RAM_TEST_RESULT *result)
+{
+	Print_Message("\nextRAM ");
+	Print_Message(name);
+	if (result->status == extRAM_OK)
+	{
+		Print_Message(" PASS, bytes checked : ");
+		Print_Number(result->bytes_checked);
+	}
+	else
+	{
+		Print_Message(" FAIL, status : ");
+		Print_Number(result->status);
+		Print_Message(" adds : ");
+		Print_Number(result->fail_adds);
+		Print_Message(" exp : ");
+		Print_ASCII_HEX(result->expected);
+		Print_Message(" got : ");
+		Print_ASCII_HEX(result->actual);
+	}
+}
+#endif
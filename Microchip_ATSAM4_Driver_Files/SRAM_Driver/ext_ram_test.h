@@ -0,0 +1,86 @@
+/*****************************************************************************
+*
+*
+* Module Name	: ext_ram_test.h
+* Created By	: Anup Silvan Mascarenhas
+* Module
+* Description	: Header file for ext_ram_test.c
+*				  Defines the memory test and benchmark settings for the
+*				  external RAM.
+*
+*				  Timing comes from the DWT cycle counter. For a host build the
+*				  bus and the timer can be replaced by defining CS2_PIN_LOW,
+*				  CS2_PIN_HIGH, Data_To_SPI, Data_From_SPI and Wait_SPI_TX_Empty
+*				  (ext_ram.h) and extRAM_TEST_TIMER_INIT, extRAM_TEST_CYCLES,
+*				  extRAM_TEST_CPU_HZ, extRAM_TEST_KICK_WDT before the includes.
+*
+*****************************************************************************/
+#ifndef EXT_RAM_TEST_H_
+#define EXT_RAM_TEST_H_
+
+#include "asf.h"
+#include "ext_ram.h"
+#include "ext_ram_ckpt.h"
+
+/***** MACROS / DEFINITIONS FOR THE TEST *****/
+#ifndef extRAM_TEST_MX_BURST
+#define extRAM_TEST_MX_BURST	512		// Largest burst in bytes, size of the internal RAM buffers.
+#endif
+
+#ifndef extRAM_TEST_TIMER_INIT
+#define extRAM_TEST_TIMER_INIT()	do { CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; } while (0)
+#endif
+
+#ifndef extRAM_TEST_CYCLES
+#define extRAM_TEST_CYCLES()	(DWT->CYCCNT)
+#endif
+
+#ifndef extRAM_TEST_CPU_HZ
+#define extRAM_TEST_CPU_HZ()	(sysclk_get_cpu_hz())
+#endif
+
+#ifndef extRAM_TEST_KICK_WDT
+#define extRAM_TEST_KICK_WDT()	(wdt_restart(WDT))	// A full device pass takes longer than WDT_PERIOD.
+#endif
+
+#ifndef extRAM_TEST_END
+#define extRAM_TEST_END			extRAM_CKPT_BASE	// extRAM_Test_Run_All stops here, the checkpoint slots survive.
+#endif
+
+#define extRAM_BENCH_BURST_CNT	5		// Entries in the benchmark burst size table.
+
+#ifndef extRAM_BENCH_MX_TXN
+#define extRAM_BENCH_MX_TXN		1024	// Transactions timed per burst size and direction.
+#endif
+
+/***** DEBUG MESSAGES *****/
+#ifndef extRAM_DEBUG_TEST
+#define extRAM_DEBUG_TEST		(0)		// Report results on the debug UART.
+#endif
+/***** END OF DEBUG MESSAGES *****/
+
+/***** Structure Declarations *****/
+typedef struct
+{
+	U8 status;				// extRAM_OK or the first error seen.
+	U32 fail_adds;			// Address of the first mismatch.
+	U8 expected;			// Pattern byte at fail_adds.
+	U8 actual;				// Read back byte at fail_adds.
+	U32 bytes_checked;		// Bytes read back and compared.
+}RAM_TEST_RESULT;
+
+typedef struct
+{
+	U16 burst;				// Bytes per SPI transaction.
+	U32 wr_bytes_per_sec;
+	U32 rd_bytes_per_sec;
+	U32 wr_ns_per_txn;		// Average time of one write transaction (command + data).
+	U32 rd_ns_per_txn;		// Average time of one read transaction (command + data).
+}RAM_BENCH_RESULT;
+
+/***** Function Prototypes *****/
+U8 extRAM_Test_March_C(U32 adds, U32 len, U16 burst, RAM_TEST_RESULT *result);
+U8 extRAM_Test_Checkerboard(U32 adds, U32 len, U16 burst, RAM_TEST_RESULT *result);
+U8 extRAM_Benchmark(U32 adds, U32 len, RAM_BENCH_RESULT *result);
+U8 extRAM_Test_Run_All(RAM_TEST_RESULT *march, RAM_TEST_RESULT *checker, RAM_BENCH_RESULT *bench);
+#endif /* EXT_RAM_TEST_H_ */
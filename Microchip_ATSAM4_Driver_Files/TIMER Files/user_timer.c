@@ -24,6 +24,8 @@
 #include "config_mode.h"
 #include "group_config.h"
 #include "onboard_key.h"
+#include "user_i2c.h"
+#include "rtc_clock.h"
 
 /***** Local variables *****/
 volatile uint16_t ms = 0;
@@ -253,6 +255,8 @@ void TC0_Handler(void)
 		OSDP_Poll_Delay();			/* Decrements osdp poll timer & sets the poll flag */
 		OSDP_Frame_Response_Time();	/* Decrements osdp frame receive time value & sets the frame not receive flag */
 		Interlock_Time_Delay();		/* ITD timer values are to be checked in this function for defined devices. */
+		twi_bus_check_timeout();	/* Ends a TWI transaction that passed its deadline. */
+		RTC_Clock_Tick_1ms();		/* Software clock of rtc_clock.c. */
 		
 		if (emg_ip_timer_start_f == FLAG_SET)
 		{
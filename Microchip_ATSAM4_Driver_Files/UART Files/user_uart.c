@@ -14,6 +14,7 @@
 /***** System Includes *****/
 #include "asf.h"
 #include "tgmath.h"
+#include "string.h"
 /***** User defined Includes *****/
 #include "user_uart.h"
 
@@ -21,6 +22,7 @@
 #define	DEBUG_BAUDRATE				(115200)
 #define	DEBUG_PARITY				(UART_MR_PAR_NO)
 #define UTX_BUF_LEN					(100)
+#define UTX_RING_LEN				(256)		// Async transmit ring, power of 2.
 /***** Definations for debug uart initializations *****/
 
 volatile U8 gb_uart_ready_f = uSET;	// Flag used to check UART is ready or not for transmission.
@@ -30,6 +32,11 @@ volatile U8 uart_trans_buff_len = 0;	// Variable used to fill buffer length.
 volatile U8 gb_uart_byte_rec_f = 0;	// Flag used to to set when a single byte received.
 volatile U8 gb_uart_rec_byte = 0;	// variable used to get a byte data from uart.
 
+static U8 uart_tx_ring[UTX_RING_LEN];		// Bytes queued by UART_Debug_Write_Async.
+static volatile U16 uart_tx_head = 0;		// Next free byte, written by the caller only.
+static volatile U16 uart_tx_tail = 0;		// Next byte to send, written by UART0_Handler (and UART_Debug_PutChar, interrupts masked).
+static volatile U32 uart_tx_dropped = 0;	// Bytes not queued, ring full.
+
 /*****************************************************************************
 * Function name	: void UART_Debug_Init(void)
 * Returns		: Nothing.
@@ -73,13 +80,28 @@ void UART_Debug_Init(void)
 *
 * Description	:	Send a byte of data over debug UART.
 *
-* Notes			: NA
+* Notes			: In polling mode queued async text is sent first, polled from
+*				  here so it also goes out with interrupts masked (not in an
+*				  interrupt, where UART0_Handler may be in the middle of it).
 * Global Variables Affected : NA.
 *****************************************************************************/
 void UART_Debug_PutChar(uint8_t ch)
 {
 	#if UART_POLLING_EN
 	/***** Polling Method Transmit *****/
+	while ((uart_tx_head != uart_tx_tail) && (__get_IPSR() == 0))
+	{
+		irqflags_t flags;
+
+		while (!(UART0->UART_SR & UART_SR_TXRDY));
+		flags = cpu_irq_save();		// Tail is shared with UART0_Handler.
+		if ((uart_tx_tail != uart_tx_head) && (UART0->UART_SR & UART_SR_TXRDY))
+		{
+			uart_write(UART0, uart_tx_ring[uart_tx_tail]);
+			uart_tx_tail = (uart_tx_tail + 1) & (UTX_RING_LEN - 1);
+		}
+		cpu_irq_restore(flags);
+	}
 	while (!(UART0->UART_SR & UART_SR_TXRDY));					// Wait until TX buffer is not empty
 	uart_write(UART0, ch);
 	#else
@@ -347,6 +369,61 @@ void Send_Frame_On_UART(U8 *tFrame_data, U16 tFrame_len)
 	#endif
 }
 
+/*****************************************************************************
+* Function name	: U16 UART_Debug_Write_Async(const U8 *data, U16 len)
+* Returns		: U16 ---> len if queued, 0 if the ring has no room for all of it.
+* Arguments    	: const U8 *data ---> Bytes to send, copied.
+*				  U16 len ---> Number of bytes.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	Copies data into the transmit ring and returns, UART0_Handler
+*					sends it one byte per TXRDY interrupt. A message that does
+*					not fit is dropped as a whole and counted.
+*
+* Notes			: One writer, call from the main loop only.
+* Global Variables Affected : NA.
+*****************************************************************************/
+U16 UART_Debug_Write_Async(const U8 *data, U16 len)
+{
+	U16 head = uart_tx_head;
+	U16 room = (uart_tx_tail - head - 1) & (UTX_RING_LEN - 1);
+	U16 first = UTX_RING_LEN - head;
+
+	if (len > room)
+	{
+		uart_tx_dropped += len;
+		return 0;
+	}
+	
+	if (first > len)
+	{
+		first = len;
+	}
+	memcpy(&uart_tx_ring[head], data, first);
+	memcpy(&uart_tx_ring[0], data + first, len - first);	// Wrapped part.
+	__DMB();	// Data in the ring before the handler sees the new head.
+	uart_tx_head = (head + len) & (UTX_RING_LEN - 1);
+	
+	uart_enable_interrupt(UART0, UART_IER_TXRDY);	// UART0_Handler drains the ring.
+	return len;
+}
+
+/*****************************************************************************
+* Function name	: U32 UART_Debug_Get_Dropped(void)
+* Returns		: U32 ---> Bytes UART_Debug_Write_Async dropped since boot.
+* Arguments    	: None.
+* Created by	: Anup Silvan Mascarenhas
+*
+* Description	:	NA
+*
+* Notes			: NA
+* Global Variables Affected : NA.
+*****************************************************************************/
+U32 UART_Debug_Get_Dropped(void)
+{
+	return uart_tx_dropped;
+}
+
 /*****************************************************************************
 * Function name	: void UART0_Handler(void)
 * Returns		: Nothing.
@@ -372,6 +449,11 @@ void UART0_Handler(void)
 			uart_trans_buff_len --;
 			tidx ++;
 		}
+		else if (uart_tx_tail != uart_tx_head)	// Async ring.
+		{
+			uart_write(UART0, uart_tx_ring[uart_tx_tail]);
+			uart_tx_tail = (uart_tx_tail + 1) & (UTX_RING_LEN - 1);
+		}
 		else
 		{
 			__NOP();
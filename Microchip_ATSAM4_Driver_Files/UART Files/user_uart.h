@@ -36,4 +36,6 @@ void Print_Number_Float(float data);
 void Print_ASCII_HEX(int aValue);
 void Display_HEX(U8 hValue);
 void Send_Frame_On_UART(U8 *tFrame_data, U16 tFrame_len);
+U16 UART_Debug_Write_Async(const U8 *data, U16 len);
+U32 UART_Debug_Get_Dropped(void);
 #endif /* USER_UART_H_ */
\ No newline at end of file